@@ -1,96 +1,181 @@
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <optional>
 #include <sstream>
+#include <vector>
 #include "frontend/lexer.h"
 #include "frontend/parser.h"
 #include "midend/ir.h"
+#include "midend/pass_manager.h"
 
 using namespace cs160::frontend;
 using namespace cs160::midend;
 
 void usage(char const* programName) {
   std::cerr
-      << "Usage: " << programName << " program.l1 "
-      << "This program runs a GCSE optimization pass over an L1 program. ";
+      << "Usage: " << programName
+      << " [-O0|-O1|-O2] [--passes=a,b,c] [--gvn] [--short-circuit] "
+      << "[--time-passes] [--jobs=N] program.l1 output\n"
+      << "       " << programName
+      << " [options] [--suffix=.out] --batch program.l1...\n"
+      << "       " << programName << " [options] --manifest=file\n"
+      << "This program optimizes an L1 program with a pipeline of passes. "
+      << "By default it runs a GCSE optimization pass alone. -O1 runs local "
+      << "value numbering and GCSE, followed by copy propagation and dead "
+      << "code elimination, with the control flow simplified before and "
+      << "after. -O0 runs no passes, and -O2 also eliminates tail "
+      << "recursion, inlines small functions, and runs SCCP, GVN, lazy code "
+      << "motion, loop-invariant code motion and strength reduction. "
+      << "--passes replaces the pipeline with the passes named. With "
+      << "--gvn, global value numbering replaces GCSE and the instruction "
+      << "counts of both are reported. With "
+      << "--short-circuit (implied by -O2), guards of conditionals and "
+      << "loops are lowered to jumps that skip the right operand of && and "
+      << "|| once the left one decides. --time-passes reports the time "
+      << "and instruction count change of each pass. Functions are "
+      << "optimized concurrently on N threads, by default one per "
+      << "hardware thread; the output does not depend on N. "
+      << "With --batch, every program named is compiled in this one "
+      << "process, programs rather than functions running concurrently, "
+      << "each to its own name followed by the suffix. A manifest lists "
+      << "one program per line, optionally followed by its output file. ";
 }
 
-int main(int argc, char* argv[]) {
-  std::string outputFileName;
+// How every program of a run is compiled
+struct Options {
+  std::string pipeline;
+  bool useGVN = false;
+  bool shortCircuit = false;
+  bool timePasses = false;
+};
 
-  if (argc == 3) {
-    outputFileName = argv[2];
-  } else {
-    usage(argv[0]);
-    return 1;
+// The comma separated pipeline with every pass called from renamed to
+std::string replacePass(const std::string& pipeline, const std::string& from,
+                        const std::string& to) {
+  std::stringstream list(pipeline);
+  std::string name, replaced;
+  while (std::getline(list, name, ',')) {
+    replaced += (replaced.empty() ? "" : ",") + (name == from ? to : name);
   }
+  return replaced;
+}
 
-  std::ifstream programFile{argv[1]};
-  if (!programFile.is_open()) {
-    std::cerr << "'" << argv[1]
-              << "' does not exist or is not a regular file.\n\n";
-    usage(argv[0]);
+Module copyModule(const Module& module) {
+  Module copy;
+  for (const auto& [name, cfg] : module.functions) {
+    copy.functions[name] = std::make_unique<CFG>(cfg->getBlocks());
+  }
+  copy.params = module.params;
+  return copy;
+}
 
+// Compiles the L1 program in inputFileName into outputFileName, running
+// its functions on pool if given. Progress goes to log and problems to
+// errors. Returns whether the output was written.
+bool compileFile(const std::string& inputFileName,
+                 const std::string& outputFileName, const Options& options,
+                 ThreadPool* pool, std::ostream& log, std::ostream& errors) {
+  // names and SSA versions of this program, freed with it
+  NameTable names;
+  NameScope nameScope(names);
+  PassManager passes;
+  passes.add(options.useGVN ? replacePass(options.pipeline, "gcse", "gvn")
+                            : options.pipeline);
+
+  std::ifstream programFile{inputFileName};
+  if (!programFile.is_open()) {
+    errors << "'" << inputFileName
+           << "' does not exist or is not a regular file." << std::endl;
+    return false;
   }  // Read the file
   std::string programText{std::istreambuf_iterator<char>(programFile),
                           std::istreambuf_iterator<char>()};
 
   // Run the lexer
-  std::cout << "Lexing the input program '" << argv[1] << "'" << std::endl;
+  log << "Lexing the input program '" << inputFileName << "'" << std::endl;
   Lexer lexer;
   auto tokens = lexer.tokenize(programText);
 
   // Run the parser
-  std::cout << "Parsing the token stream" << std::endl;
+  log << "Parsing the token stream" << std::endl;
   Parser parser(tokens);
   auto ast = parser.parse();
 
   if (!ast) {
-    std::cerr << "Parse error: the parser produced an empty unique_ptr"
-              << std::endl;
-    return 1;
+    errors << "Parse error: the parser produced an empty unique_ptr"
+           << std::endl;
+    return false;
   }
 
   // Run the IR
-  std::cout << "Generating IR" << std::endl;
+  log << "Generating IR" << std::endl;
 
   // Write out the IR (unoptimized)
   std::ofstream irFile{outputFileName};
 
   if (!irFile.is_open()) {
-    std::cerr << "Failed to open the outfile '" << outputFileName << "'"
-              << std::endl;
-    return 1;
+    errors << "Failed to open the outfile '" << outputFileName << "'"
+           << std::endl;
+    return false;
   }
 
-  IR ir;
-  auto insns = ir.generateCFG(*ast);
-  auto m = ir.ProgramBlocks();
+  IR ir(options.shortCircuit);
+  ir.generateCFG(*ast);
+  auto module = ir.buildModule();
 
-  for (auto p = m.cbegin(); p != m.cend(); ++p) {
+  // GCSE runs on a copy only to report how the two compare. The copies
+  // of each result into _optN that nothing reads are cleaned up before
+  // counting, as the pipelines of -O1 and -O2 do after GVN.
+  std::optional<Module> gcse;
+  PassManager gcsePasses;
+  std::map<std::string, std::size_t> unoptimized;
+  if (options.useGVN) {
+    gcse = copyModule(module);
+    gcsePasses.add(replacePass(options.pipeline, "gvn", "gcse") + ",cleanup");
+    gcsePasses.run(*gcse, pool);
+    for (const auto& [name, cfg] : module.functions) {
+      unoptimized[name] = cfg->instructionCount();
+    }
+  }
+  passes.run(module, pool);
+
+  for (auto& [name, function] : module.functions) {
     // function definitions
-    irFile << "function: " << p->first << std::endl;
+    irFile << "function: " << name << std::endl;
 
-    CFG cfg(p->second);
-    cfg.computeAvailExprs();  // populates availableExpressions
-    auto genkill_sets = cfg.getAllGenKill();
-    auto optimized_function = cfg.computeGCSE(genkill_sets);
+    // solved again on the final code, so the sets match the blocks printed
+    // below whatever passes ran
+    auto& cfg = *function;
+    cfg.computeAvailExprs();
+    log << "Available expressions for '" << name << "' converged after "
+        << cfg.getWorklistIterations() << " block visits" << std::endl;
+    if (options.useGVN) {
+      log << "Instructions in '" << name << "': " << unoptimized[name]
+          << " before, " << gcse->functions.at(name)->instructionCount()
+          << " after GCSE, " << cfg.instructionCount() << " after GVN"
+          << std::endl;
+    }
+    const auto& optimized_function = cfg.getBlocks();
 
     // just write out in/out sets to top of file
     irFile << "\t\tFIXED POINT SOLUTION" << std::endl;
-    auto availExprs = cfg.getAvailableExpressions();
+    const auto& availExprs = cfg.getAvailableExpressions();
     for (auto iter = availExprs.cbegin(); iter != availExprs.cend(); ++iter) {
       auto idx = std::distance(availExprs.cbegin(), iter);
       irFile << "block: " << std::to_string(idx) << std::endl;
       irFile << "in: ";
-      for (auto i = availExprs[idx].first.cbegin();
-           i != availExprs[idx].first.cend(); ++i) {
-        irFile << *i << " ";
+      const auto& in = availExprs[idx].first;
+      for (std::size_t i = 0; i < in.size(); ++i) {
+        irFile << in[i] << " ";
       }
       irFile << std::endl;
       irFile << "out: ";
-      for (auto i = availExprs[idx].second.cbegin();
-           i != availExprs[idx].second.cend(); ++i) {
-        irFile << *i << "  ";
+      const auto& out = availExprs[idx].second;
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        irFile << out[i] << "  ";
       }
       irFile << std::endl << std::endl;
     }
@@ -105,13 +190,176 @@ int main(int argc, char* argv[]) {
       irFile << " block " << std::to_string(idx) << ":" << std::endl;
 
       // blocks of instructions
-      auto instr = v->instructions();
+      const auto& instr = v->instructions();
       for (auto b = instr.cbegin(); b != instr.cend(); ++b) {
-        irFile << "    " << b->toString() << std::endl;
+        irFile << "    " << *b << std::endl;
       }
     }
     irFile << std::endl;
   }
 
-  return 0;
+  if (options.timePasses) {
+    passes.printStatistics(log);
+  }
+  return true;
+}
+
+// Like compileFile, but reporting what stops the compilation to errors
+bool tryCompileFile(const std::string& inputFileName,
+                    const std::string& outputFileName, const Options& options,
+                    ThreadPool* pool, std::ostream& log,
+                    std::ostream& errors) {
+  try {
+    return compileFile(inputFileName, outputFileName, options, pool, log,
+                       errors);
+  } catch (const std::exception& e) {
+    errors << inputFileName << ": " << e.what() << std::endl;
+    return false;
+  }
+}
+
+// (input, output) file names
+using FileList = std::vector<std::pair<std::string, std::string>>;
+
+// Reads the (input, output) pairs of a manifest. Outputs not given are the
+// input followed by suffix.
+std::optional<FileList> readManifest(const std::string& manifestFileName,
+                                     const std::string& suffix) {
+  std::ifstream manifest{manifestFileName};
+  if (!manifest.is_open()) {
+    return std::nullopt;
+  }
+  FileList files;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    std::stringstream fields(line);
+    std::string input, output;
+    if (!(fields >> input)) {
+      continue;
+    }
+    if (!(fields >> output)) {
+      output = input + suffix;
+    }
+    files.emplace_back(input, output);
+  }
+  return files;
+}
+
+// Compiles every file on pool, one task per program, the largest first.
+// The log and errors of each program are printed in the order given.
+bool compileBatch(const FileList& files, const Options& options,
+                  ThreadPool& pool) {
+  std::vector<std::uintmax_t> sizes(files.size(), 0);
+  std::vector<std::size_t> order(files.size());
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    std::error_code error;
+    auto size = std::filesystem::file_size(files[i].first, error);
+    sizes[i] = error ? 0 : size;
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](auto i, auto j) { return sizes[i] > sizes[j]; });
+
+  std::vector<std::stringstream> logs(files.size()), errors(files.size());
+  std::vector<char> compiled(files.size(), false);
+  for (auto i : order) {
+    pool.submit([&, i] {
+      compiled[i] = tryCompileFile(files[i].first, files[i].second, options,
+                                   nullptr, logs[i], errors[i]);
+    });
+  }
+  pool.wait();
+
+  bool succeeded = true;
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    std::cout << logs[i].str();
+    std::cerr << errors[i].str();
+    succeeded &= compiled[i] != 0;
+  }
+  std::cout << "Compiled " << std::count(compiled.begin(), compiled.end(), 1)
+            << " of " << files.size() << " programs" << std::endl;
+  return succeeded;
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  std::optional<int> level;
+  std::size_t jobs = 0;
+  std::optional<std::string> passList, manifest;
+  bool batch = false;
+  std::string suffix = ".out";
+  int arg = 1;
+  for (; arg < argc; ++arg) {
+    std::string flag = argv[arg];
+    if (flag == "--gvn") {
+      options.useGVN = true;
+    } else if (flag == "--short-circuit") {
+      options.shortCircuit = true;
+    } else if (flag == "--time-passes") {
+      options.timePasses = true;
+    } else if (flag == "-O0" || flag == "-O1" || flag == "-O2") {
+      level = flag[2] - '0';
+    } else if (flag.rfind("--passes=", 0) == 0) {
+      passList = flag.substr(std::string("--passes=").size());
+    } else if (flag.rfind("--jobs=", 0) == 0) {
+      jobs = std::stoul(flag.substr(std::string("--jobs=").size()));
+    } else if (flag == "--batch") {
+      batch = true;
+    } else if (flag.rfind("--suffix=", 0) == 0) {
+      suffix = flag.substr(std::string("--suffix=").size());
+    } else if (flag.rfind("--manifest=", 0) == 0) {
+      manifest = flag.substr(std::string("--manifest=").size());
+    } else {
+      break;
+    }
+  }
+  int positional = argc - arg;
+  if (manifest ? positional != 0
+               : batch ? positional == 0 : positional != 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // Without a level GCSE runs alone, the output tests/*.l1.opt expect
+  options.pipeline = passList ? *passList
+                     : level  ? PassManager::pipeline(*level)
+                              : "gcse";
+  options.shortCircuit |= level == 2;
+  PassManager passes;
+  try {
+    passes.add(options.useGVN
+                   ? replacePass(options.pipeline, "gcse", "gvn")
+                   : options.pipeline);
+  } catch (const PassError& e) {
+    std::cerr << e.what() << "; the passes are";
+    for (const auto& name : passes.registeredPasses()) {
+      std::cerr << " " << name;
+    }
+    std::cerr << std::endl;
+    return 1;
+  }
+
+  ThreadPool pool(jobs);
+  if (!manifest && !batch) {
+    return tryCompileFile(argv[arg], argv[arg + 1], options, &pool,
+                          std::cout, std::cerr)
+               ? 0
+               : 1;
+  }
+
+  FileList files;
+  if (manifest) {
+    auto listed = readManifest(*manifest, suffix);
+    if (!listed) {
+      std::cerr << "Failed to open the manifest '" << *manifest << "'"
+                << std::endl;
+      return 1;
+    }
+    files = std::move(*listed);
+  } else {
+    for (; arg < argc; ++arg) {
+      files.emplace_back(argv[arg], argv[arg] + suffix);
+    }
+  }
+  return compileBatch(files, options, pool) ? 0 : 1;
 }
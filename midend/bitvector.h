@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+namespace cs160::midend {
+
+// Dense fixed-size set of bits backed by 64-bit words. The set operations
+// work in place a whole word at a time (simple loops the compiler can
+// vectorize) and report whether the destination changed, which is all a
+// dataflow solver needs to decide if a block has to be revisited.
+//
+// Bits past size() in the last word are always kept clear, so comparisons
+// and counts can look at whole words.
+class BitVector {
+ public:
+  BitVector() {}
+  explicit BitVector(std::size_t size, bool value = false)
+      : size_(size), words_((size + 63) / 64, value ? ~uint64_t(0) : 0) {
+    clearTail();
+  }
+
+  std::size_t size() const { return size_; }
+
+  bool test(std::size_t i) const { return (words_[i / 64] >> (i % 64)) & 1; }
+  bool operator[](std::size_t i) const { return test(i); }
+  void set(std::size_t i) { words_[i / 64] |= uint64_t(1) << (i % 64); }
+  void reset(std::size_t i) { words_[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+
+  void setAll() {
+    std::fill(words_.begin(), words_.end(), ~uint64_t(0));
+    clearTail();
+  }
+  void resetAll() { std::fill(words_.begin(), words_.end(), 0); }
+
+  // this &= rhs
+  bool intersectWith(const BitVector& rhs) {
+    uint64_t changed = 0;
+    for (std::size_t w = 0; w < words_.size(); ++w) {
+      uint64_t next = words_[w] & rhs.words_[w];
+      changed |= next ^ words_[w];
+      words_[w] = next;
+    }
+    return changed != 0;
+  }
+
+  // this |= rhs
+  bool unionWith(const BitVector& rhs) {
+    uint64_t changed = 0;
+    for (std::size_t w = 0; w < words_.size(); ++w) {
+      uint64_t next = words_[w] | rhs.words_[w];
+      changed |= next ^ words_[w];
+      words_[w] = next;
+    }
+    return changed != 0;
+  }
+
+  // this &= ~rhs
+  bool subtract(const BitVector& rhs) {
+    uint64_t changed = 0;
+    for (std::size_t w = 0; w < words_.size(); ++w) {
+      uint64_t next = words_[w] & ~rhs.words_[w];
+      changed |= next ^ words_[w];
+      words_[w] = next;
+    }
+    return changed != 0;
+  }
+
+  // this = gen | (in & ~kill), the usual gen/kill transfer function fused
+  // into one pass over the words
+  bool assignTransfer(const BitVector& gen, const BitVector& in,
+                      const BitVector& kill) {
+    uint64_t changed = 0;
+    for (std::size_t w = 0; w < words_.size(); ++w) {
+      uint64_t next = gen.words_[w] | (in.words_[w] & ~kill.words_[w]);
+      changed |= next ^ words_[w];
+      words_[w] = next;
+    }
+    return changed != 0;
+  }
+
+  bool any() const {
+    for (auto w : words_) {
+      if (w != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::size_t count() const {
+    std::size_t n = 0;
+    for (auto w : words_) {
+      n += __builtin_popcountll(w);
+    }
+    return n;
+  }
+
+  // Calls f(i) for every set bit i in increasing order
+  template <typename F>
+  void forEachSetBit(F f) const {
+    for (std::size_t w = 0; w < words_.size(); ++w) {
+      uint64_t bits = words_[w];
+      while (bits != 0) {
+        f(w * 64 + __builtin_ctzll(bits));
+        bits &= bits - 1;
+      }
+    }
+  }
+
+  bool operator==(const BitVector& rhs) const {
+    return size_ == rhs.size_ && words_ == rhs.words_;
+  }
+  bool operator!=(const BitVector& rhs) const { return !operator==(rhs); }
+
+ private:
+  void clearTail() {
+    if (size_ % 64 != 0) {
+      words_.back() &= (uint64_t(1) << (size_ % 64)) - 1;
+    }
+  }
+
+  std::size_t size_ = 0;
+  std::vector<uint64_t> words_;
+};
+
+}  // namespace cs160::midend
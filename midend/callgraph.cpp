@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <utility>
+
+#include "midend/callgraph.h"
+
+namespace cs160::midend {
+
+CallGraph::CallGraph(const Module& module) {
+  for (const auto& [name, cfg] : module.functions) {
+    names.push_back(name);
+  }
+  calleeOffsets.push_back(0);
+  for (const auto& [name, cfg] : module.functions) {
+    std::vector<int> callees;
+    for (const auto& block : cfg->getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        if (instr.isLabel() || instr.getOpcode() != Opcode::CALL) {
+          continue;
+        }
+        int callee = find(instr.getOperand1().GetVariableName());
+        if (callee >= 0) {
+          callees.push_back(callee);
+        }
+      }
+    }
+    std::sort(callees.begin(), callees.end());
+    callees.erase(std::unique(callees.begin(), callees.end()), callees.end());
+    calleeEdges.insert(calleeEdges.end(), callees.begin(), callees.end());
+    calleeOffsets.push_back(calleeEdges.size());
+  }
+  findComponents();
+}
+
+int CallGraph::find(const std::string& name) const {
+  auto it = std::lower_bound(names.begin(), names.end(), name);
+  return it != names.end() && *it == name ? it - names.begin() : -1;
+}
+
+bool CallGraph::isRecursive(int f) const {
+  if (sccs[componentOf[f]].size() > 1) {
+    return true;
+  }
+  auto calls = callees(f);
+  return std::binary_search(calls.begin(), calls.end(), f);
+}
+
+// Tarjan's algorithm with an explicit stack. Components are completed in
+// reverse topological order, which is the callees-first order wanted.
+void CallGraph::findComponents() {
+  auto n = size();
+  std::vector<int> index(n, -1), lowlink(n, 0);
+  std::vector<bool> onStack(n, false);
+  std::vector<int> stack;
+  // (function, next callee to visit) for the depth-first search
+  std::vector<std::pair<int, std::size_t>> path;
+  int next = 0;
+  componentOf.assign(n, -1);
+
+  for (std::size_t root = 0; root < n; ++root) {
+    if (index[root] >= 0) {
+      continue;
+    }
+    path.emplace_back(root, 0);
+    while (!path.empty()) {
+      auto& [f, k] = path.back();
+      if (k == 0) {
+        index[f] = lowlink[f] = next++;
+        stack.push_back(f);
+        onStack[f] = true;
+      }
+      auto calls = callees(f);
+      if (k < calls.size()) {
+        int g = calls[k++];
+        if (index[g] < 0) {
+          path.emplace_back(g, 0);
+        } else if (onStack[g]) {
+          lowlink[f] = std::min(lowlink[f], index[g]);
+        }
+        continue;
+      }
+      int done = f;
+      path.pop_back();
+      if (!path.empty()) {
+        int parent = path.back().first;
+        lowlink[parent] = std::min(lowlink[parent], lowlink[done]);
+      }
+      if (lowlink[done] != index[done]) {
+        continue;
+      }
+      std::vector<int> component;
+      int g;
+      do {
+        g = stack.back();
+        stack.pop_back();
+        onStack[g] = false;
+        componentOf[g] = sccs.size();
+        component.push_back(g);
+      } while (g != done);
+      std::sort(component.begin(), component.end());
+      sccs.push_back(std::move(component));
+    }
+  }
+}
+
+}  // namespace cs160::midend
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "midend/ir.h"
+
+namespace cs160::midend {
+
+// The calls between the functions of a module, read off their CALL
+// instructions. Functions are numbered in the order of Module::functions;
+// calls to functions the module does not define are left out.
+class CallGraph {
+ public:
+  explicit CallGraph(const Module& module);
+
+  std::size_t size() const { return names.size(); }
+  const std::string& name(int f) const { return names[f]; }
+  // The number of the function called name, -1 if it is not defined
+  int find(const std::string& name) const;
+
+  // Functions called by f, sorted and without duplicates, as CSR like the
+  // edges of a CFG
+  EdgeRange callees(int f) const {
+    return EdgeRange(calleeEdges.data() + calleeOffsets[f],
+                     calleeEdges.data() + calleeOffsets[f + 1]);
+  }
+
+  // Strongly connected components, callees first: a component comes after
+  // every component it calls into
+  const std::vector<std::vector<int>>& components() const { return sccs; }
+  int component(int f) const { return componentOf[f]; }
+  // Whether f can call itself, directly or through other functions
+  bool isRecursive(int f) const;
+
+ private:
+  void findComponents();
+
+  std::vector<std::string> names;
+  std::vector<int> calleeOffsets, calleeEdges;
+  std::vector<std::vector<int>> sccs;
+  std::vector<int> componentOf;
+};
+
+}  // namespace cs160::midend
@@ -0,0 +1,532 @@
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "midend/ir.h"
+
+// Block orderings, dominators and loops of a CFG. Everything here is
+// computed lazily and cached until setBlocks() replaces the function body.
+// All traversals use explicit stacks so CFGs with hundreds of thousands of
+// blocks (or deeply nested loops) cannot overflow the call stack.
+
+namespace cs160::midend {
+
+namespace {
+
+// Flattens per-node lists into offset/edge arrays, sorting and
+// deduplicating each list
+void toCSR(std::vector<std::vector<int>>& lists, std::vector<int>& offsets,
+           std::vector<int>& edges) {
+  offsets.assign(lists.size() + 1, 0);
+  edges.clear();
+  for (std::size_t i = 0; i < lists.size(); ++i) {
+    auto& list = lists[i];
+    std::sort(list.begin(), list.end());
+    list.erase(std::unique(list.begin(), list.end()), list.end());
+    edges.insert(edges.end(), list.begin(), list.end());
+    offsets[i + 1] = edges.size();
+  }
+}
+
+}  // namespace
+
+void CFG::setBlocks(std::vector<BasicBlock> blocks) {
+  basic_blocks = std::move(blocks);
+  buildEdges();
+  invalidateAnalyses();
+}
+
+// A critical fall-through edge gets its new (empty) block right after the
+// source. A critical jump edge gets a block appended to the function, which
+// is labelled SPLIT_n and jumps on to the old target, and the source's jump
+// is retargeted to that label. Old blocks keep their relative order either
+// way, so only the edges being split move within each phi's argument list.
+bool CFG::splitCriticalEdges() {
+  auto n = basic_blocks.size();
+  auto isCritical = [&](int from, int to) {
+    return successors(from).size() > 1 && predecessors(to).size() > 1;
+  };
+
+  // new numbering: old blocks shift past the fall-through splits before them
+  std::vector<int> newIndex(n);
+  std::vector<int> fallthroughSplit(n, -1);
+  std::vector<int> jumpSplit(n, -1);
+  int next = 0;
+  for (std::size_t b = 0; b < n; ++b) {
+    newIndex[b] = next++;
+    if (b + 1 < n && isCritical(b, b + 1) &&
+        !basic_blocks[b].instructions().back().endsFallthrough()) {
+      fallthroughSplit[b] = next++;
+    }
+  }
+  int maxID = 0;
+  uint32_t nextLabel = 0;
+  for (std::size_t b = 0; b < n; ++b) {
+    maxID = std::max(maxID, basic_blocks[b].getBlockID());
+    for (const auto& instr : basic_blocks[b].instructions()) {
+      auto label = instr.getLabel();
+      if (label && label->GetNameKind() == NameKind::Split) {
+        nextLabel = std::max(nextLabel, label->GetId() + 1);
+      }
+    }
+  }
+
+  std::vector<BasicBlock> blocks;
+  std::vector<BasicBlock> appended;
+  blocks.reserve(n);
+  for (std::size_t b = 0; b < n; ++b) {
+    blocks.push_back(basic_blocks[b]);
+    if (fallthroughSplit[b] >= 0) {
+      blocks.push_back(BasicBlock({}, ++maxID));
+    }
+    auto& instrs = basic_blocks[b].instructions();
+    if (instrs.empty() ||
+        instrs.back().getOpcode() != Opcode::jump_conditional) {
+      continue;
+    }
+    for (int succ : successors(b)) {
+      if (succ == static_cast<int>(b) + 1 || !isCritical(b, succ)) {
+        continue;
+      }
+      Operand label(NameKind::Split, nextLabel++, OperandType::Label);
+      appended.push_back(
+          BasicBlock({Instruction(label),
+                      Instruction(Opcode::jump_unconditional,
+                                  instrs.back().getJumpTarget())},
+                     ++maxID));
+      auto& source = blocks[newIndex[b]];
+      auto retargeted = source.instructions();
+      retargeted.back().setJumpTarget(label);
+      source.setInstructions(std::move(retargeted));
+      jumpSplit[b] = next++;
+    }
+  }
+  if (appended.empty() && blocks.size() == n) {
+    return false;
+  }
+  for (auto& block : appended) {
+    blocks.push_back(std::move(block));
+  }
+
+  for (std::size_t b = 0; b < n; ++b) {
+    auto phis = basic_blocks[b].phis();
+    if (phis.empty()) {
+      continue;
+    }
+    auto preds = predecessors(b);
+    std::vector<std::pair<int, int>> order;  // (new predecessor, old position)
+    for (std::size_t i = 0; i < preds.size(); ++i) {
+      int pred = preds[i];
+      int now = newIndex[pred];
+      if (fallthroughSplit[pred] >= 0 && pred + 1 == static_cast<int>(b)) {
+        now = fallthroughSplit[pred];
+      } else if (jumpSplit[pred] >= 0 && pred + 1 != static_cast<int>(b)) {
+        now = jumpSplit[pred];
+      }
+      order.emplace_back(now, i);
+    }
+    std::sort(order.begin(), order.end());
+    for (auto& phi : phis) {
+      std::vector<Operand> args;
+      for (auto [pred, i] : order) {
+        args.push_back(phi.args[i]);
+      }
+      phi.args = std::move(args);
+    }
+    blocks[newIndex[b]].setPhis(std::move(phis));
+  }
+
+  setBlocks(std::move(blocks));
+  return true;
+}
+
+bool CFG::isolateEntry() {
+  if (basic_blocks.empty() || predecessors(0).empty()) {
+    return false;
+  }
+  int maxID = 0;
+  for (const auto& block : basic_blocks) {
+    maxID = std::max(maxID, block.getBlockID());
+  }
+  std::vector<BasicBlock> blocks;
+  blocks.reserve(basic_blocks.size() + 1);
+  blocks.push_back(BasicBlock({}, maxID + 1));
+  std::move(basic_blocks.begin(), basic_blocks.end(),
+            std::back_inserter(blocks));
+  setBlocks(std::move(blocks));
+  return true;
+}
+
+int CFG::preheader(int loop) const {
+  const auto& natural = loops()[loop];
+  int header = natural.header;
+  int outside = -1;
+  for (int pred : predecessors(header)) {
+    if (std::binary_search(natural.blocks.begin(), natural.blocks.end(),
+                           pred)) {
+      continue;
+    }
+    if (outside >= 0) {
+      return -1;
+    }
+    outside = pred;
+  }
+  return outside >= 0 && successors(outside).size() == 1 ? outside : -1;
+}
+
+bool CFG::insertPreheaders() {
+  auto n = basic_blocks.size();
+  std::vector<bool> needed(n, false);
+  bool any = false;
+  for (std::size_t l = 0; l < loops().size(); ++l) {
+    int header = loops()[l].header;
+    const auto& blocks = loops()[l].blocks;
+    int above = header - 1;
+    bool fallsInFromLoop =
+        above >= 0 &&
+        std::binary_search(blocks.begin(), blocks.end(), above) &&
+        (basic_blocks[above].instructions().empty() ||
+         !basic_blocks[above].instructions().back().endsFallthrough());
+    if (preheader(l) < 0 && header > 0 && !fallsInFromLoop) {
+      needed[header] = true;
+      any = true;
+    }
+  }
+  if (!any) {
+    return false;
+  }
+
+  int maxID = 0;
+  uint32_t nextLabel = 0;
+  for (const auto& block : basic_blocks) {
+    maxID = std::max(maxID, block.getBlockID());
+    for (const auto& instr : block.instructions()) {
+      auto label = instr.getLabel();
+      if (label && label->GetNameKind() == NameKind::Preheader) {
+        nextLabel = std::max(nextLabel, label->GetId() + 1);
+      }
+    }
+  }
+
+  // label of the preheader to jump to instead of each header, by header
+  std::vector<std::optional<Operand>> redirect(n);
+  std::vector<int> newIndex(n);
+  std::vector<BasicBlock> blocks;
+  blocks.reserve(n + loops().size());
+  for (std::size_t b = 0; b < n; ++b) {
+    if (needed[b]) {
+      Operand label(NameKind::Preheader, nextLabel++, OperandType::Label);
+      blocks.push_back(BasicBlock({Instruction(label)}, ++maxID));
+      redirect[b] = label;
+    }
+    newIndex[b] = blocks.size();
+    blocks.push_back(basic_blocks[b]);
+  }
+
+  // jumps from outside a loop into its header now go to the preheader
+  for (const auto& loop : loops()) {
+    if (!redirect[loop.header]) {
+      continue;
+    }
+    const auto& header = basic_blocks[loop.header].instructions();
+    std::optional<Operand> headerLabel;
+    if (!header.empty()) {
+      headerLabel = header.front().getLabel();
+    }
+    for (int pred : predecessors(loop.header)) {
+      if (std::binary_search(loop.blocks.begin(), loop.blocks.end(), pred)) {
+        continue;
+      }
+      const auto& instrs = basic_blocks[pred].instructions();
+      if (instrs.empty()) {
+        continue;
+      }
+      auto op = instrs.back().getOpcode();
+      if ((op == Opcode::jump_unconditional ||
+           op == Opcode::jump_conditional) &&
+          instrs.back().getJumpTarget() == headerLabel) {
+        auto& source = blocks[newIndex[pred]];
+        auto retargeted = source.instructions();
+        retargeted.back().setJumpTarget(*redirect[loop.header]);
+        source.setInstructions(std::move(retargeted));
+      }
+    }
+  }
+  setBlocks(std::move(blocks));
+  return true;
+}
+
+void CFG::invalidateAnalyses() {
+  order.valid = false;
+  dom.valid = false;
+  loopInfo.valid = false;
+}
+
+void CFG::computeOrder() const {
+  auto n = basic_blocks.size();
+  order.rpo.clear();
+  order.number.assign(n, -1);
+  order.valid = true;
+  if (n == 0) {
+    return;
+  }
+
+  std::vector<int> postorder;
+  postorder.reserve(n);
+  std::vector<bool> visited(n, false);
+  std::vector<std::pair<int, const int*>> stack;
+  visited[0] = true;
+  stack.emplace_back(0, successors(0).begin());
+  while (!stack.empty()) {
+    auto& [block, next] = stack.back();
+    if (next == successors(block).end()) {
+      postorder.push_back(block);
+      stack.pop_back();
+      continue;
+    }
+    int succ = *next++;
+    if (!visited[succ]) {
+      visited[succ] = true;
+      stack.emplace_back(succ, successors(succ).begin());
+    }
+  }
+
+  order.rpo.assign(postorder.rbegin(), postorder.rend());
+  for (std::size_t i = 0; i < order.rpo.size(); ++i) {
+    order.number[order.rpo[i]] = i;
+  }
+}
+
+const std::vector<int>& CFG::reversePostorder() const {
+  if (!order.valid) {
+    computeOrder();
+  }
+  return order.rpo;
+}
+
+int CFG::rpoNumber(int block) const {
+  if (!order.valid) {
+    computeOrder();
+  }
+  return order.number[block];
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm": iterate
+// idom[b] = intersect of the processed predecessors over the blocks in
+// reverse postorder, walking up the partial dominator tree by postorder
+// number. Dominance frontiers are then collected by walking up from each
+// predecessor of a join point to the join point's idom.
+void CFG::computeDominators() const {
+  const auto& rpo = reversePostorder();
+  auto n = basic_blocks.size();
+  dom.idom.assign(n, -1);
+  dom.valid = true;
+
+  if (!rpo.empty()) {
+    // idoms are kept as rpo numbers while iterating, the entry is its own
+    std::vector<int> idom(rpo.size(), -1);
+    idom[0] = 0;
+    auto intersect = [&](int a, int b) {
+      while (a != b) {
+        while (a > b) {
+          a = idom[a];
+        }
+        while (b > a) {
+          b = idom[b];
+        }
+      }
+      return a;
+    };
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (std::size_t i = 1; i < rpo.size(); ++i) {
+        int next = -1;
+        for (int pred : predecessors(rpo[i])) {
+          int p = order.number[pred];
+          if (p < 0 || idom[p] < 0) {
+            continue;  // unreachable or not processed yet
+          }
+          next = next < 0 ? p : intersect(p, next);
+        }
+        if (idom[i] != next) {
+          idom[i] = next;
+          changed = true;
+        }
+      }
+    }
+    for (std::size_t i = 1; i < rpo.size(); ++i) {
+      dom.idom[rpo[i]] = rpo[idom[i]];
+    }
+  }
+
+  std::vector<std::vector<int>> lists(n);
+  for (std::size_t b = 0; b < n; ++b) {
+    if (dom.idom[b] >= 0) {
+      lists[dom.idom[b]].push_back(b);
+    }
+  }
+  toCSR(lists, dom.childOffsets, dom.children);
+
+  // number the dominator tree so dominates(a, b) is an interval check
+  dom.enter.assign(n, -1);
+  dom.exit.assign(n, -1);
+  if (!rpo.empty()) {
+    int clock = 0;
+    std::vector<std::pair<int, const int*>> stack;
+    dom.enter[0] = clock++;
+    stack.emplace_back(0, domChildren(0).begin());
+    while (!stack.empty()) {
+      auto& [block, next] = stack.back();
+      if (next == domChildren(block).end()) {
+        dom.exit[block] = clock++;
+        stack.pop_back();
+        continue;
+      }
+      int child = *next++;
+      dom.enter[child] = clock++;
+      stack.emplace_back(child, domChildren(child).begin());
+    }
+  }
+
+  for (auto& list : lists) {
+    list.clear();
+  }
+  for (int b : rpo) {
+    auto preds = predecessors(b);
+    if (preds.size() < 2) {
+      continue;
+    }
+    for (int pred : preds) {
+      if (order.number[pred] < 0) {
+        continue;
+      }
+      for (int runner = pred; runner != dom.idom[b] && runner >= 0;
+           runner = dom.idom[runner]) {
+        lists[runner].push_back(b);
+      }
+    }
+  }
+  toCSR(lists, dom.frontierOffsets, dom.frontiers);
+}
+
+int CFG::idom(int block) const {
+  if (!dom.valid) {
+    computeDominators();
+  }
+  return dom.idom[block];
+}
+
+EdgeRange CFG::domChildren(int block) const {
+  if (!dom.valid) {
+    computeDominators();
+  }
+  return EdgeRange(dom.children.data() + dom.childOffsets[block],
+                   dom.children.data() + dom.childOffsets[block + 1]);
+}
+
+bool CFG::dominates(int a, int b) const {
+  if (!dom.valid) {
+    computeDominators();
+  }
+  if (dom.enter[a] < 0 || dom.enter[b] < 0) {
+    return false;
+  }
+  return dom.enter[a] <= dom.enter[b] && dom.exit[b] <= dom.exit[a];
+}
+
+EdgeRange CFG::dominanceFrontier(int block) const {
+  if (!dom.valid) {
+    computeDominators();
+  }
+  return EdgeRange(dom.frontiers.data() + dom.frontierOffsets[block],
+                   dom.frontiers.data() + dom.frontierOffsets[block + 1]);
+}
+
+// A back edge is an edge t -> h where h dominates t. The loop of header h
+// is h plus everything that reaches one of its latches backwards without
+// going through h. Loops are then ordered by size, so an enclosing loop
+// always comes before the loops nested in it, and each block's innermost
+// loop is the last (smallest) loop that contains it.
+void CFG::computeLoops() const {
+  auto n = basic_blocks.size();
+  loopInfo.loops.clear();
+  loopInfo.innermost.assign(n, -1);
+  loopInfo.valid = true;
+
+  std::vector<int> loopOfHeader(n, -1);
+  for (int b : reversePostorder()) {
+    for (int succ : successors(b)) {
+      if (dominates(succ, b)) {
+        if (loopOfHeader[succ] < 0) {
+          loopOfHeader[succ] = loopInfo.loops.size();
+          loopInfo.loops.push_back(NaturalLoop{succ, {}, {}});
+        }
+        loopInfo.loops[loopOfHeader[succ]].latches.push_back(b);
+      }
+    }
+  }
+
+  std::vector<int> mark(n, -1);
+  std::vector<int> stack;
+  for (std::size_t l = 0; l < loopInfo.loops.size(); ++l) {
+    auto& loop = loopInfo.loops[l];
+    mark[loop.header] = l;
+    loop.blocks.push_back(loop.header);
+    for (int latch : loop.latches) {
+      if (mark[latch] != static_cast<int>(l)) {
+        mark[latch] = l;
+        stack.push_back(latch);
+      }
+    }
+    while (!stack.empty()) {
+      int block = stack.back();
+      stack.pop_back();
+      loop.blocks.push_back(block);
+      for (int pred : predecessors(block)) {
+        if (mark[pred] != static_cast<int>(l) && rpoNumber(pred) >= 0) {
+          mark[pred] = l;
+          stack.push_back(pred);
+        }
+      }
+    }
+    std::sort(loop.blocks.begin(), loop.blocks.end());
+  }
+
+  std::stable_sort(loopInfo.loops.begin(), loopInfo.loops.end(),
+                   [](const NaturalLoop& a, const NaturalLoop& b) {
+                     return a.blocks.size() > b.blocks.size();
+                   });
+  for (std::size_t l = 0; l < loopInfo.loops.size(); ++l) {
+    auto& loop = loopInfo.loops[l];
+    loop.parent = loopInfo.innermost[loop.header];
+    loop.depth =
+        loop.parent < 0 ? 1 : loopInfo.loops[loop.parent].depth + 1;
+    for (int block : loop.blocks) {
+      loopInfo.innermost[block] = l;
+    }
+  }
+}
+
+const std::vector<NaturalLoop>& CFG::loops() const {
+  if (!loopInfo.valid) {
+    computeLoops();
+  }
+  return loopInfo.loops;
+}
+
+int CFG::innermostLoop(int block) const {
+  if (!loopInfo.valid) {
+    computeLoops();
+  }
+  return loopInfo.innermost[block];
+}
+
+int CFG::loopDepth(int block) const {
+  int loop = innermostLoop(block);
+  return loop < 0 ? 0 : loopInfo.loops[loop].depth;
+}
+
+}  // namespace cs160::midend
@@ -0,0 +1,259 @@
+#include <utility>
+#include <vector>
+
+#include "midend/dataflow.h"
+#include "midend/passes.h"
+
+// Copy propagation over available copies, plus coalescing of temporaries
+// into the variables they are copied to.
+//
+// A copy x <- y (y a variable or a constant) is available at a point if it
+// runs on every path there and neither x nor y is assigned after it, the
+// must problem
+//
+//   AvailOut(b) = CopyGen(b) | (AvailIn(b) - CopyKill(b)), meet is &
+//
+// and a use of x where x <- y is available reads y instead. Copies are
+// numbered in an ExprTable as NIL keys (x, y), NIL being the copy opcode.
+//
+// Coalescing catches what the IR generator emits for every assignment,
+// t <- a op b; x <- t, and rewrites it to x <- a op b when t is assigned and
+// read nowhere else and x is neither read nor assigned in between.
+
+namespace cs160::midend {
+
+namespace {
+
+bool isCopy(const Instruction& instr) {
+  return instr.isDefinition() && instr.getOpcode() == Opcode::NIL &&
+         instr.getOperand1().GetOperandType() != OperandType::None &&
+         instr.getOperand0() != instr.getOperand1();
+}
+
+class CopyPropagation {
+ public:
+  explicit CopyPropagation(CFG& cfg) : cfg(cfg) {}
+
+  bool run() {
+    collectCopies();
+    if (copies.empty()) {
+      return false;
+    }
+    std::vector<BitVectorPair> genkill;
+    genkill.reserve(cfg.size());
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      genkill.push_back(computeGenKill(b));
+    }
+    DataflowAnalysis<BitVector, Forward, IntersectMeet,
+                     GenKillTransfer<BitVector>>
+        avail(cfg, BitVector(copies.size()), BitVector(copies.size(), true),
+              {genkill});
+    avail.run();
+
+    bool changed = false;
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      changed |= rewrite(b, avail.in(b));
+    }
+    return changed;
+  }
+
+ private:
+  void collectCopies() {
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        if (!isCopy(instr)) {
+          continue;
+        }
+        auto size = copies.size();
+        int c = copies.insert(
+            ExprKey(Opcode::NIL, instr.getOperand0(), instr.getOperand1()));
+        if (copies.size() == size) {
+          continue;
+        }
+        for (auto operand : {instr.getOperand0(), instr.getOperand1()}) {
+          if (operand.GetOperandType() == OperandType::Var) {
+            std::size_t v = vars.insert(operand);
+            copiesUsingVar.resize(vars.size());
+            copiesUsingVar[v].push_back(c);
+          }
+        }
+        std::size_t v = vars.find(instr.getOperand0());
+        copiesTo.resize(vars.size());
+        copiesTo[v].push_back(c);
+      }
+    }
+  }
+
+  // Applies instr to the set of copies available before it
+  void transfer(const Instruction& instr, BitVector& available,
+                BitVector* killed) const {
+    if (!instr.isDefinition()) {
+      return;
+    }
+    int v = vars.find(instr.getOperand0());
+    if (v >= 0) {
+      for (int c : copiesUsingVar[v]) {
+        available.reset(c);
+        if (killed) {
+          killed->set(c);
+        }
+      }
+    }
+    if (isCopy(instr)) {
+      available.set(copies.find(ExprKey(Opcode::NIL, instr.getOperand0(),
+                                        instr.getOperand1())));
+    }
+  }
+
+  BitVectorPair computeGenKill(int b) const {
+    BitVector gen(copies.size());
+    BitVector kill(copies.size());
+    for (const auto& instr : cfg.getBlocks()[b].instructions()) {
+      transfer(instr, gen, &kill);
+    }
+    return {std::move(gen), std::move(kill)};
+  }
+
+  bool rewrite(int b, BitVector available) {
+    bool changed = false;
+    auto instrs = cfg.getBlocks()[b].instructions();
+    for (auto& instr : instrs) {
+      // the sets were computed on the copies as they were
+      auto original = instr;
+      instr.forEachUse([&](Operand& use) {
+        int v = vars.find(use);
+        if (v < 0 || static_cast<std::size_t>(v) >= copiesTo.size()) {
+          return;
+        }
+        for (int c : copiesTo[v]) {
+          if (available.test(c)) {
+            use = copies.key(c).rhs;
+            changed = true;
+            return;
+          }
+        }
+      });
+      transfer(original, available, nullptr);
+    }
+    if (changed) {
+      cfg.getBlock(b).setInstructions(std::move(instrs));
+    }
+    return changed;
+  }
+
+  CFG& cfg;
+  ExprTable copies;
+  IndexTable<Operand, OperandHash> vars;
+  std::vector<std::vector<int>> copiesUsingVar;
+  // copies into each variable, for the variables that are copied to
+  std::vector<std::vector<int>> copiesTo;
+};
+
+// Rewrites t <- e; ...; x <- t to x <- e; ... for temporaries t defined and
+// read once, and drops copies of a variable to itself
+bool coalesceTemporaries(CFG& cfg) {
+  IndexTable<Operand, OperandHash> temps;
+  std::vector<int> defs, uses;
+  auto slot = [&](const Operand& operand) {
+    std::size_t t = temps.insert(operand);
+    defs.resize(temps.size(), 0);
+    uses.resize(temps.size(), 0);
+    return t;
+  };
+  for (const auto& block : cfg.getBlocks()) {
+    for (const auto& phi : block.phis()) {
+      for (const auto& arg : phi.args) {
+        if (arg.isTemporary()) {
+          ++uses[slot(arg)];
+        }
+      }
+      if (phi.lhs.isTemporary()) {
+        ++defs[slot(phi.lhs)];
+      }
+    }
+    for (const auto& instr : block.instructions()) {
+      instr.forEachUse([&](const Operand& use) {
+        if (use.isTemporary()) {
+          ++uses[slot(use)];
+        }
+      });
+      if (instr.isDefinition() && instr.getOperand0().isTemporary()) {
+        ++defs[slot(instr.getOperand0())];
+      }
+    }
+  }
+
+  bool changed = false;
+  for (std::size_t b = 0; b < cfg.size(); ++b) {
+    auto instrs = cfg.getBlocks()[b].instructions();
+    std::vector<bool> removed(instrs.size(), false);
+    // position of the definition of each single-use temporary in this block
+    std::vector<int> definedAt(temps.size(), -1);
+    bool blockChanged = false;
+    for (std::size_t j = 0; j < instrs.size(); ++j) {
+      const auto& instr = instrs[j];
+      if (!instr.isDefinition()) {
+        continue;
+      }
+      auto src = instr.getOpcode() == Opcode::NIL ? instr.getOperand1()
+                                                  : Operand();
+      auto dst = instr.getOperand0();
+      if (instr.getOpcode() == Opcode::NIL && src == dst) {
+        removed[j] = blockChanged = true;
+        continue;
+      }
+      int t = src.isTemporary() ? temps.find(src) : -1;
+      if (t >= 0 && definedAt[t] >= 0) {
+        // x must keep its value up to the copy
+        bool clobbered = false;
+        for (std::size_t k = definedAt[t] + 1; k < j && !clobbered; ++k) {
+          instrs[k].forEachUse(
+              [&](const Operand& use) { clobbered |= use == dst; });
+          clobbered |=
+              instrs[k].isDefinition() && instrs[k].getOperand0() == dst;
+        }
+        if (!clobbered) {
+          instrs[definedAt[t]].setOperand0(dst);
+          removed[j] = blockChanged = true;
+          definedAt[t] = -1;
+          continue;
+        }
+      }
+      if (dst.isTemporary()) {
+        int d = temps.find(dst);
+        if (defs[d] == 1 && uses[d] == 1) {
+          definedAt[d] = j;
+        }
+      }
+    }
+    if (!blockChanged) {
+      continue;
+    }
+    std::vector<Instruction> kept;
+    kept.reserve(instrs.size());
+    for (std::size_t j = 0; j < instrs.size(); ++j) {
+      if (!removed[j]) {
+        kept.push_back(std::move(instrs[j]));
+      }
+    }
+    cfg.getBlock(b).setInstructions(std::move(kept));
+    changed = true;
+  }
+  return changed;
+}
+
+}  // namespace
+
+bool propagateCopies(CFG& cfg) {
+  bool changed = false;
+  bool progress = true;
+  while (progress) {
+    progress = removeUnusedTemporaries(cfg);
+    progress |= coalesceTemporaries(cfg);
+    progress |= CopyPropagation(cfg).run();
+    changed |= progress;
+  }
+  return changed;
+}
+
+}  // namespace cs160::midend
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "midend/bitvector.h"
+#include "midend/ir.h"
+
+namespace cs160::midend {
+
+// Direction tags. Forward problems compute in from the predecessors' out
+// sets and apply the transfer function to get out; backward problems
+// compute out from the successors' in sets and transfer it to in.
+struct Forward {};
+struct Backward {};
+
+// Meet operators for must (intersection) and may (union) problems. They
+// work on any domain with in-place set operations, e.g. BitVector, and
+// return whether acc changed.
+struct IntersectMeet {
+  template <typename Domain>
+  bool operator()(Domain& acc, const Domain& value) const {
+    return acc.intersectWith(value);
+  }
+};
+
+struct UnionMeet {
+  template <typename Domain>
+  bool operator()(Domain& acc, const Domain& value) const {
+    return acc.unionWith(value);
+  }
+};
+
+// The classic gen/kill transfer function, output = gen | (input & ~kill),
+// over per-block (gen, kill) pairs.
+template <typename Domain>
+struct GenKillTransfer {
+  const std::vector<std::pair<Domain, Domain>>& genkill;
+
+  bool operator()(int block, const Domain& input, Domain& output) const {
+    return output.assignTransfer(genkill[block].first, input,
+                                 genkill[block].second);
+  }
+};
+
+// Iterative dataflow solver over a CFG.
+//
+// Domain    - the lattice value of a block, e.g. BitVector
+// Direction - Forward or Backward
+// Meet      - bool(Domain& acc, const Domain& value), combines facts at a
+//             join point and returns whether acc changed
+// Transfer  - bool(int block, const Domain& input, Domain& output), writes
+//             the block's output for the given input and returns whether
+//             output changed
+//
+// Every block starts at top (the identity of Meet). The entry block (for
+// forward problems) or the blocks without successors (for backward ones)
+// additionally meet with the boundary value. Blocks are prioritized in
+// reverse postorder for forward problems and postorder for backward ones,
+// and a block's dependents are re-enqueued only when its output changes.
+template <typename Domain, typename Direction, typename Meet,
+          typename Transfer>
+class DataflowAnalysis {
+ public:
+  static constexpr bool forward = std::is_same<Direction, Forward>::value;
+
+  DataflowAnalysis(const CFG& cfg, Domain boundary, Domain top,
+                   Transfer transfer, Meet meet = Meet())
+      : cfg_(cfg),
+        boundary_(std::move(boundary)),
+        top_(std::move(top)),
+        transfer_(std::move(transfer)),
+        meet_(std::move(meet)) {}
+
+  void run() {
+    auto n = cfg_.size();
+    iterations_ = 0;
+    sets_.assign(n, std::make_pair(top_, top_));
+    if (n == 0) {
+      return;
+    }
+
+    std::vector<int> order = cfg_.reversePostorder();
+    if (!forward) {
+      std::reverse(order.begin(), order.end());
+    }
+    std::vector<int> priority(n, -1);
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      priority[order[i]] = i;
+    }
+    for (std::size_t b = 0; b < n; ++b) {
+      if (priority[b] < 0) {
+        priority[b] = order.size();
+        order.push_back(b);
+      }
+    }
+
+    std::priority_queue<int, std::vector<int>, std::greater<int>> worklist;
+    std::vector<bool> queued(n, true);
+    for (std::size_t i = 0; i < n; ++i) {
+      worklist.push(i);
+    }
+
+    while (!worklist.empty()) {
+      int block = order[worklist.top()];
+      worklist.pop();
+      queued[block] = false;
+      ++iterations_;
+
+      auto& input = forward ? sets_[block].first : sets_[block].second;
+      auto& output = forward ? sets_[block].second : sets_[block].first;
+      auto sources =
+          forward ? cfg_.predecessors(block) : cfg_.successors(block);
+      input = top_;
+      for (int src : sources) {
+        meet_(input, forward ? sets_[src].second : sets_[src].first);
+      }
+      if (forward ? block == 0 : sources.empty()) {
+        meet_(input, boundary_);
+      }
+
+      if (transfer_(block, input, output)) {
+        auto dependents =
+            forward ? cfg_.successors(block) : cfg_.predecessors(block);
+        for (int dep : dependents) {
+          if (!queued[dep]) {
+            queued[dep] = true;
+            worklist.push(priority[dep]);
+          }
+        }
+      }
+    }
+  }
+
+  const Domain& in(int block) const { return sets_[block].first; }
+  const Domain& out(int block) const { return sets_[block].second; }
+  // (in, out) per block; can be moved out once the analysis is done
+  std::vector<std::pair<Domain, Domain>>& results() { return sets_; }
+  // Number of transfer function evaluations done by the last run
+  int iterations() const { return iterations_; }
+
+ private:
+  const CFG& cfg_;
+  Domain boundary_;
+  Domain top_;
+  Transfer transfer_;
+  Meet meet_;
+  std::vector<std::pair<Domain, Domain>> sets_;
+  int iterations_ = 0;
+};
+
+}  // namespace cs160::midend
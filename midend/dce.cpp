@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "midend/index_table.h"
+#include "midend/liveness.h"
+#include "midend/passes.h"
+
+namespace cs160::midend {
+
+// Counts the reads of every temporary once, then sweeps the blocks until no
+// more definitions die, so chains of temporaries feeding only each other
+// go away together
+bool removeUnusedTemporaries(CFG& cfg) {
+  IndexTable<Operand, OperandHash> temps;
+  std::vector<int> uses;
+  auto count = [&](const Operand& operand, int delta) {
+    std::size_t t = temps.insert(operand);
+    uses.resize(temps.size(), 0);
+    uses[t] += delta;
+    return uses[t];
+  };
+  for (const auto& block : cfg.getBlocks()) {
+    for (const auto& phi : block.phis()) {
+      for (const auto& arg : phi.args) {
+        if (arg.isTemporary()) {
+          count(arg, 1);
+        }
+      }
+    }
+    for (const auto& instr : block.instructions()) {
+      instr.forEachUse([&](const Operand& use) {
+        if (use.isTemporary()) {
+          count(use, 1);
+        }
+      });
+    }
+  }
+
+  bool changed = false;
+  bool removed = true;
+  while (removed) {
+    removed = false;
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      std::vector<Instruction> kept;
+      kept.reserve(instrs.size());
+      for (const auto& instr : instrs) {
+        bool dead = instr.isDefinition() && instr.getOpcode() != Opcode::CALL &&
+                    instr.getOperand0().isTemporary() &&
+                    count(instr.getOperand0(), 0) == 0;
+        if (dead) {
+          instr.forEachUse([&](const Operand& use) {
+            if (use.isTemporary()) {
+              count(use, -1);
+            }
+          });
+          removed = true;
+        } else {
+          kept.push_back(instr);
+        }
+      }
+      if (kept.size() != instrs.size()) {
+        cfg.getBlock(b).setInstructions(std::move(kept));
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+namespace {
+
+// What one sweep of sweepDeadCode did
+struct Sweep {
+  bool removed = false;
+  // a deletion took a variable out of the live-in set of its block, which
+  // can leave definitions of it dead in the blocks before
+  bool liveInShrank = false;
+};
+
+// One backwards sweep over every block from live, which must be solved for
+// the current code
+Sweep sweepDeadCode(CFG& cfg, const Liveness& live) {
+  Sweep sweep;
+  for (std::size_t b = 0; b < cfg.size(); ++b) {
+    const auto& instrs = cfg.getBlocks()[b].instructions();
+    BitVector liveNow = live.liveOut(b);
+    std::vector<Instruction> kept;
+    kept.reserve(instrs.size());
+    for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+      bool dead = it->isDefinition() && it->getOpcode() != Opcode::CALL &&
+                  !liveNow.test(live.variables().find(it->getOperand0()));
+      if (dead) {
+        continue;
+      }
+      live.transfer(*it, liveNow);
+      kept.push_back(*it);
+    }
+    if (kept.size() != instrs.size()) {
+      sweep.liveInShrank |= liveNow != live.liveIn(b);
+      std::reverse(kept.begin(), kept.end());
+      cfg.getBlock(b).setInstructions(std::move(kept));
+      sweep.removed = true;
+    }
+  }
+  return sweep;
+}
+
+}  // namespace
+
+// Each round sweeps every block backwards from its live out set, so dead
+// chains within a block go in one round. As long as no live-in set
+// changes, the live-out sets the sweep started from still hold and
+// nothing else can have died. Otherwise liveness is solved again for
+// another round.
+bool eliminateDeadCode(CFG& cfg, const Liveness& live) {
+  auto sweep = sweepDeadCode(cfg, live);
+  bool removed = sweep.removed;
+  while (sweep.liveInShrank) {
+    sweep = sweepDeadCode(cfg, Liveness(cfg));
+  }
+  return removed;
+}
+
+bool eliminateDeadCode(CFG& cfg) {
+  return eliminateDeadCode(cfg, Liveness(cfg));
+}
+
+}  // namespace cs160::midend
@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "midend/index_table.h"
+#include "midend/passes.h"
+
+// Dominator-based value numbering on SSA form. A variable holds a single
+// value for its whole lifetime in SSA, so value numbers are global to the
+// function. What is scoped to the dominator tree is the leader of each
+// value: the constant or the variable holding it whose definition dominates
+// the block being visited. A computation whose value already has a leader
+// becomes a copy of it, and every use is rewritten to the leader of its
+// value, which also propagates copies and constants.
+
+namespace cs160::midend {
+
+namespace {
+
+class GlobalValues {
+ public:
+  // Numbers constants and variables defined on entry (unversioned names)
+  // on first sight, their leader is themselves everywhere
+  int valueOf(const Operand& operand) {
+    std::size_t slot = operands.insert(operand);
+    if (slot == operandValue.size()) {
+      int value = fresh();
+      operandValue.push_back(value);
+      leader[value] = operand;
+      if (operand.GetOperandType() == OperandType::Int) {
+        constant[value] = operand.GetConstant();
+      }
+    }
+    return operandValue[slot];
+  }
+
+  // The value of operand if it is known at this point of the walk. SSA
+  // versions read through a back edge have not been numbered yet.
+  std::optional<int> knownValueOf(const Operand& operand) {
+    int slot = operands.find(operand);
+    if (slot >= 0) {
+      return operandValue[slot];
+    }
+    if (operand.GetOperandType() == OperandType::Var && operand.version()) {
+      return std::nullopt;
+    }
+    return valueOf(operand);
+  }
+
+  void bind(const Operand& var, int value) {
+    std::size_t slot = operands.insert(var);
+    operandValue.resize(operands.size(), -1);
+    operandValue[slot] = value;
+  }
+
+  int valueOf(const ValueExpr& expr) {
+    std::size_t id = exprs.insert(expr);
+    if (id == exprValue.size()) {
+      exprValue.push_back(fresh());
+    }
+    return exprValue[id];
+  }
+
+  int fresh() {
+    leader.push_back(Operand());
+    constant.push_back(std::nullopt);
+    return leader.size() - 1;
+  }
+
+  std::optional<int> constantOf(int value) const { return constant[value]; }
+
+  // The operand making value available, None if there is none
+  std::vector<Operand> leader;
+
+ private:
+  IndexTable<Operand, OperandHash> operands;
+  std::vector<int> operandValue;
+  IndexTable<ValueExpr, ValueExprHash> exprs;
+  std::vector<int> exprValue;
+  std::vector<std::optional<int>> constant;
+};
+
+class GlobalValueNumbering {
+ public:
+  explicit GlobalValueNumbering(CFG& cfg)
+      : cfg(cfg), redundantPhis(cfg.size()) {}
+
+  bool run() {
+    if (cfg.size() == 0) {
+      return false;
+    }
+    enter(0);
+    while (!stack.empty()) {
+      auto& frame = stack.back();
+      if (frame.next == cfg.domChildren(frame.block).end()) {
+        for (auto it = frame.saved.rbegin(); it != frame.saved.rend(); ++it) {
+          values.leader[it->first] = it->second;
+        }
+        stack.pop_back();
+        continue;
+      }
+      enter(*frame.next++);
+    }
+
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      if (redundantPhis[b].empty()) {
+        continue;
+      }
+      std::vector<Phi> kept;
+      const auto& phis = cfg.getBlocks()[b].phis();
+      for (std::size_t i = 0; i < phis.size(); ++i) {
+        if (!redundantPhis[b][i]) {
+          kept.push_back(phis[i]);
+        }
+      }
+      cfg.getBlock(b).setPhis(std::move(kept));
+    }
+    return changed;
+  }
+
+ private:
+  // (block, next dominator tree child, leaders to restore on the way out)
+  struct Frame {
+    int block;
+    const int* next;
+    std::vector<std::pair<int, Operand>> saved;
+  };
+
+  bool available(int value) const {
+    return values.leader[value].GetOperandType() != OperandType::None;
+  }
+
+  void makeLeader(Frame& frame, int value, const Operand& var) {
+    frame.saved.emplace_back(value, values.leader[value]);
+    values.leader[value] = var;
+  }
+
+  // Rewrites operand to the leader of its value, if that is known
+  void useLeader(Operand& operand) {
+    auto value = values.knownValueOf(operand);
+    if (value && available(*value) && values.leader[*value] != operand) {
+      operand = values.leader[*value];
+      changed = true;
+    }
+  }
+
+  void numberPhis(Frame& frame) {
+    auto phis = cfg.getBlocks()[frame.block].phis();
+    auto& redundant = redundantPhis[frame.block];
+    redundant.assign(phis.size(), false);
+    for (std::size_t i = 0; i < phis.size(); ++i) {
+      // a phi whose arguments (other than itself) all have one value is
+      // that value
+      std::optional<int> same;
+      bool meaningful = false;
+      for (const auto& arg : phis[i].args) {
+        if (arg == phis[i].lhs) {
+          continue;
+        }
+        auto value = values.knownValueOf(arg);
+        if (!value || (same && *same != *value)) {
+          meaningful = true;
+          break;
+        }
+        same = value;
+      }
+      if (!meaningful && same && available(*same)) {
+        values.bind(phis[i].lhs, *same);
+        redundant[i] = true;
+        changed = true;
+        continue;
+      }
+      int value = meaningful || !same ? values.fresh() : *same;
+      values.bind(phis[i].lhs, value);
+      makeLeader(frame, value, phis[i].lhs);
+    }
+  }
+
+  void numberInstruction(Frame& frame, Instruction& instr) {
+    instr.forEachUse([&](Operand& use) { useLeader(use); });
+    if (!instr.isDefinition()) {
+      return;
+    }
+    auto lhs = instr.getOperand0();
+    auto op = instr.getOpcode();
+    int value;
+    if (op == Opcode::CALL) {
+      value = values.fresh();
+    } else if (op == Opcode::NIL) {
+      value = values.valueOf(instr.getOperand1());
+    } else {
+      int a = values.valueOf(instr.getOperand1());
+      int b = instr.isBinary() ? values.valueOf(instr.getOperand2()) : -1;
+      auto ca = values.constantOf(a);
+      auto cb = instr.isBinary() ? values.constantOf(b) : std::optional<int>(0);
+      if (ca && cb) {
+        value = values.valueOf(Operand(EvaluateOpcode(op, *ca, *cb)));
+      } else {
+        value = values.valueOf(ValueExpr(op, a, b));
+      }
+    }
+
+    values.bind(lhs, value);
+    if (!available(value)) {
+      makeLeader(frame, value, lhs);
+    } else if (op != Opcode::NIL) {
+      instr = Instruction(lhs, values.leader[value]);
+      changed = true;
+    }
+  }
+
+  void enter(int b) {
+    Frame frame{b, cfg.domChildren(b).begin(), {}};
+    numberPhis(frame);
+    auto instrs = cfg.getBlocks()[b].instructions();
+    for (auto& instr : instrs) {
+      numberInstruction(frame, instr);
+    }
+    cfg.getBlock(b).setInstructions(std::move(instrs));
+
+    for (int succ : cfg.successors(b)) {
+      auto preds = cfg.predecessors(succ);
+      auto i = std::lower_bound(preds.begin(), preds.end(), b) - preds.begin();
+      auto phis = cfg.getBlocks()[succ].phis();
+      for (auto& phi : phis) {
+        useLeader(phi.args[i]);
+      }
+      cfg.getBlock(succ).setPhis(std::move(phis));
+    }
+    stack.push_back(std::move(frame));
+  }
+
+  CFG& cfg;
+  GlobalValues values;
+  std::vector<Frame> stack;
+  std::vector<std::vector<bool>> redundantPhis;
+  bool changed = false;
+};
+
+}  // namespace
+
+bool globalValueNumbering(CFG& cfg) {
+  bool changed = constructSSA(cfg);
+  changed |= GlobalValueNumbering(cfg).run();
+  changed |= destructSSA(cfg);
+  changed |= removeUnusedTemporaries(cfg);
+  return changed;
+}
+
+}  // namespace cs160::midend
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace cs160::midend {
+
+// Assigns dense ids 0, 1, 2, ... to keys in insertion order. Keys live in a
+// flat vector and the lookup structure is an open-addressing table of ids
+// with linear probing, so finding or numbering a key never allocates except
+// when the table has to grow.
+//
+// Hash must be a callable returning a well mixed uint64_t for a Key.
+template <typename Key, typename Hash>
+class IndexTable {
+ public:
+  explicit IndexTable(std::size_t expected = 0) { reserve(expected); }
+
+  // Returns the id of key, numbering it first if it was not seen before
+  int insert(const Key& key) {
+    if ((keys_.size() + 1) * 4 > slots_.size() * 3) {
+      grow();
+    }
+    auto slot = probe(key);
+    if (slots_[slot] < 0) {
+      slots_[slot] = keys_.size();
+      keys_.push_back(key);
+    }
+    return slots_[slot];
+  }
+
+  // Returns the id of key or -1 if it has not been numbered
+  int find(const Key& key) const {
+    if (slots_.empty()) {
+      return -1;
+    }
+    return slots_[probe(key)];
+  }
+
+  const Key& key(int id) const { return keys_[id]; }
+  const std::vector<Key>& keys() const { return keys_; }
+  std::size_t size() const { return keys_.size(); }
+  bool empty() const { return keys_.empty(); }
+
+  void clear() {
+    keys_.clear();
+    slots_.assign(slots_.size(), -1);
+  }
+
+  void reserve(std::size_t expected) {
+    keys_.reserve(expected);
+    std::size_t capacity = 16;
+    while (capacity * 3 < expected * 4) {
+      capacity *= 2;
+    }
+    if (capacity > slots_.size()) {
+      rehash(capacity);
+    }
+  }
+
+ private:
+  std::size_t probe(const Key& key) const {
+    std::size_t mask = slots_.size() - 1;
+    std::size_t slot = Hash()(key) & mask;
+    while (slots_[slot] >= 0 && !(keys_[slots_[slot]] == key)) {
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  void grow() { rehash(slots_.empty() ? 16 : slots_.size() * 2); }
+
+  void rehash(std::size_t capacity) {
+    slots_.assign(capacity, -1);
+    std::size_t mask = capacity - 1;
+    for (std::size_t id = 0; id < keys_.size(); ++id) {
+      std::size_t slot = Hash()(keys_[id]) & mask;
+      while (slots_[slot] >= 0) {
+        slot = (slot + 1) & mask;
+      }
+      slots_[slot] = id;
+    }
+  }
+
+  std::vector<Key> keys_;
+  std::vector<int32_t> slots_;
+};
+
+// Finalizer from splitmix64, spreads the bits of packed keys over the table
+inline uint64_t mixBits(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+}  // namespace cs160::midend
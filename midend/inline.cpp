@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "midend/callgraph.h"
+#include "midend/liveness.h"
+#include "midend/passes.h"
+
+// Function inlining driven by the call graph. Functions are visited callees
+// first, so a callee has already had its own calls inlined (and been
+// reoptimized) when its size is weighed. Functions that can call
+// themselves are never inlined, which keeps the process finite.
+//
+// Inlining a call lhs <- CALL f in block b splits b around the call and
+// puts a copy of f's blocks in between:
+//
+//   - each arg x_j before the call becomes p_j <- x_j for the j-th
+//     parameter p_j, and callee variables read before being assigned (which
+//     a real call would find 0) are set to 0;
+//   - every variable of the copy is renamed to a fresh version, and every
+//     label to a fresh INLINE_n, so nothing clashes with the caller;
+//   - each ret v becomes lhs <- v and a jump to the label INLINE_n that
+//     starts the rest of b.
+//
+// The copies and jumps this leaves are for the reoptimization callback.
+
+namespace cs160::midend {
+
+namespace {
+
+// A call inside a loop may inline a callee this many times the threshold
+constexpr std::size_t loopBonus = 2;
+// A function stops growing by inlining past this many times the threshold
+constexpr std::size_t growthLimit = 50;
+
+struct CallSite {
+  int block;
+  std::size_t index;
+  int callee;
+};
+
+class Inliner {
+ public:
+  Inliner(Module& module, const CallGraph& graph, int caller,
+          std::size_t threshold)
+      : module(module),
+        graph(graph),
+        cfg(*module.functions.at(graph.name(caller))),
+        threshold(threshold) {}
+
+  bool run() {
+    auto sites = findCallSites();
+    if (sites.empty()) {
+      return false;
+    }
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        if (instr.isLabel() &&
+            instr.getOperand0().GetNameKind() == NameKind::Inline) {
+          nextLabel = std::max(nextLabel, instr.getOperand0().GetId() + 1);
+        }
+      }
+    }
+    // last call first, so the positions of the others stay valid
+    VersionScope scope(cfg.versionCounters());
+    bool changed = false;
+    for (auto site = sites.rbegin(); site != sites.rend(); ++site) {
+      const auto& callee = *module.functions.at(graph.name(site->callee));
+      if (cfg.instructionCount() + callee.instructionCount() >
+          growthLimit * threshold) {
+        continue;
+      }
+      changed |= inlineCall(*site, callee,
+                            module.params[graph.name(site->callee)]);
+    }
+    return changed;
+  }
+
+ private:
+  std::vector<CallSite> findCallSites() const {
+    std::vector<CallSite> sites;
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      for (std::size_t k = 0; k < instrs.size(); ++k) {
+        if (instrs[k].isLabel() || instrs[k].getOpcode() != Opcode::CALL) {
+          continue;
+        }
+        int callee = graph.find(instrs[k].getOperand1().GetVariableName());
+        if (callee < 0 || graph.isRecursive(callee)) {
+          continue;
+        }
+        auto limit = cfg.loopDepth(b) > 0 ? loopBonus * threshold : threshold;
+        if (module.functions.at(graph.name(callee))->instructionCount() <=
+            limit) {
+          sites.push_back({static_cast<int>(b), k, callee});
+        }
+      }
+    }
+    return sites;
+  }
+
+  Operand freshLabel() {
+    return Operand(NameKind::Inline, nextLabel++, OperandType::Label);
+  }
+
+  bool inlineCall(const CallSite& site, const CFG& callee,
+                  const std::vector<Operand>& params) {
+    const auto& caller = cfg.getBlocks();
+    const auto& instrs = caller[site.block].instructions();
+    const auto& call = instrs[site.index];
+
+    // the arg instructions of this call, back to the previous call
+    std::vector<std::size_t> args;
+    for (auto k = site.index; k-- > 0;) {
+      if (instrs[k].isLabel() || instrs[k].getOpcode() == Opcode::CALL) {
+        break;
+      }
+      if (instrs[k].getOpcode() == Opcode::arg) {
+        args.push_back(k);
+      }
+    }
+    if (args.size() != params.size()) {
+      return false;
+    }
+    std::reverse(args.begin(), args.end());
+
+    std::unordered_map<Operand, Operand, OperandHash> names;
+    auto rename = [&](const Operand& operand) {
+      if (operand.GetOperandType() == OperandType::Label) {
+        auto found = names.find(operand);
+        return found != names.end()
+                   ? found->second
+                   : names.emplace(operand, freshLabel()).first->second;
+      }
+      if (operand.GetOperandType() != OperandType::Var) {
+        return operand;
+      }
+      auto found = names.find(operand);
+      return found != names.end()
+                 ? found->second
+                 : names.emplace(operand, operand.newVersion()).first->second;
+    };
+
+    int nextID = 0;
+    for (const auto& block : caller) {
+      nextID = std::max(nextID, block.getBlockID() + 1);
+    }
+    std::vector<BasicBlock> blocks(caller.begin(),
+                                   caller.begin() + site.block);
+
+    // the caller up to the call, binding the parameters
+    std::vector<Instruction> before;
+    for (std::size_t k = 0, j = 0; k < site.index; ++k) {
+      if (j < args.size() && args[j] == k) {
+        before.push_back(
+            Instruction(rename(params[j]), instrs[k].getOperand0()));
+        ++j;
+      } else {
+        before.push_back(instrs[k]);
+      }
+    }
+    Liveness live(callee);
+    live.liveIn(0).forEachSetBit([&](std::size_t v) {
+      const auto& var = live.variables().key(v);
+      if (std::find(params.begin(), params.end(), var) == params.end()) {
+        before.push_back(Instruction(rename(var), Operand(0)));
+      }
+    });
+    blocks.push_back(
+        BasicBlock(std::move(before), caller[site.block].getBlockID()));
+    blocks.back().setPhis(caller[site.block].phis());
+
+    // the callee, returning to the rest of the caller's block
+    auto returnLabel = freshLabel();
+    const auto& body = callee.getBlocks();
+    for (std::size_t b = 0; b < body.size(); ++b) {
+      std::vector<Instruction> copy;
+      for (auto instr : body[b].instructions()) {
+        if (instr.isLabel()) {
+          copy.push_back(Instruction(rename(instr.getOperand0())));
+          continue;
+        }
+        if (instr.getOpcode() == Opcode::ret) {
+          copy.push_back(
+              Instruction(call.getOperand0(), rename(instr.getOperand0())));
+          if (b + 1 < body.size()) {
+            copy.push_back(
+                Instruction(Opcode::jump_unconditional, returnLabel));
+          }
+          continue;
+        }
+        instr.forEachUse([&](Operand& use) { use = rename(use); });
+        if (instr.isDefinition()) {
+          instr.setOperand0(rename(instr.getOperand0()));
+        }
+        if (instr.getOpcode() == Opcode::jump_conditional ||
+            instr.getOpcode() == Opcode::jump_unconditional) {
+          instr.setJumpTarget(rename(instr.getJumpTarget()));
+        }
+        copy.push_back(std::move(instr));
+      }
+      blocks.push_back(BasicBlock(std::move(copy), nextID++));
+    }
+
+    std::vector<Instruction> after{Instruction(returnLabel)};
+    after.insert(after.end(), instrs.begin() + site.index + 1, instrs.end());
+    blocks.push_back(BasicBlock(std::move(after), nextID++));
+    blocks.insert(blocks.end(), caller.begin() + site.block + 1, caller.end());
+    cfg.setBlocks(std::move(blocks));
+    return true;
+  }
+
+  Module& module;
+  const CallGraph& graph;
+  CFG& cfg;
+  std::size_t threshold;
+  uint32_t nextLabel = 0;
+};
+
+}  // namespace
+
+bool inlineCalls(Module& module, std::size_t threshold,
+                 const std::function<void(CFG&)>& reoptimize) {
+  CallGraph graph(module);
+  bool changed = false;
+  for (const auto& component : graph.components()) {
+    for (int f : component) {
+      if (!Inliner(module, graph, f, threshold).run()) {
+        continue;
+      }
+      changed = true;
+      if (reoptimize) {
+        reoptimize(*module.functions.at(graph.name(f)));
+      }
+    }
+  }
+  return changed;
+}
+
+}  // namespace cs160::midend
@@ -1,41 +1,23 @@
 #include <assert.h>
 
 #include <algorithm>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <numeric>
 #include <optional>
 #include <set>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "midend/ir.h"
+#include "midend/dataflow.h"
 
 namespace cs160::midend {
 
-bool sdiff(bool b1, bool b2) {
-  if (b1 == true && b2 == false) {
-    return true;
-  } else {
-    return false;
-  }
-}
-
-bool sinter(bool b1, bool b2) {
-  if (b1 == true && b2 == true) {
-    return true;
-  } else {
-    return false;
-  }
-}
-
-bool sunion(bool b1, bool b2) {
-  if (b1 == false && b2 == false) {
-    return false;
-  } else {
-    return true;
-  }
-}
-
 std::vector<std::string> split(const std::string& s, char delim) {
   std::stringstream ss(s);
   std::string item;
@@ -83,14 +65,253 @@ const std::string OpcodeToString(Opcode op_) {
   }
 }
 
+int EvaluateOpcode(Opcode op, int lhs, int rhs) {
+  auto a = static_cast<uint32_t>(lhs);
+  auto b = static_cast<uint32_t>(rhs);
+  switch (op) {
+    case Opcode::ADD:
+      return static_cast<int>(a + b);
+    case Opcode::SUB:
+      return static_cast<int>(a - b);
+    case Opcode::MUL:
+      return static_cast<int>(a * b);
+    case Opcode::LT:
+      return lhs < rhs;
+    case Opcode::LE:
+      return lhs <= rhs;
+    case Opcode::EQ:
+      return lhs == rhs;
+    case Opcode::AND:
+      return lhs != 0 && rhs != 0;
+    case Opcode::OR:
+      return lhs != 0 || rhs != 0;
+    case Opcode::NOT:
+      return lhs == 0;
+    default:
+      throw IRError("cannot evaluate " + OpcodeToString(op));
+  }
+}
+
 const std::string IRSymbolTable::tmpPrefix = "_tmp";
 
-IR::TmpVar::TmpVar(const std::string& name, IR& ir) : name(name), ir(ir) {}
+namespace {
+
+// Interned spellings, indexed by id. A deque keeps references returned by
+// NameTable::name stable while new symbols are added.
+struct InternedNames {
+  std::shared_mutex mutex;
+  std::deque<std::string> names;
+  std::unordered_map<std::string, uint32_t> ids;
+};
+
+const std::string& NameKindPrefix(NameKind kind) {
+  static const std::string prefixes[] = {"",          IRSymbolTable::tmpPrefix,
+                                         "_opt",      "IF_FALSE_",
+                                         "IF_END_",   "WHILE_START_",
+                                         "WHILE_END_", "",
+                                         "SPLIT_",    "_pre",
+                                         "PREHEADER_", "_iv",
+                                         "INLINE_",   "TAIL_START_",
+                                         "_acc",      "GUARD_"};
+  return prefixes[static_cast<int>(kind)];
+}
+
+// SSA versions, indexed by the id of a NameKind::Version operand, and the
+// last version handed out per variable outside any VersionScope
+struct VersionedNames {
+  std::shared_mutex mutex;
+  std::vector<std::pair<Operand, uint32_t>> versions;
+  VersionCounters last;
+};
+
+thread_local NameTable* scopeNames = nullptr;
+thread_local VersionCounters* scopeCounters = nullptr;
+
+// The binary operations numbered as available expressions. OR is not one
+// of them, as in the expected outputs in tests/.
+bool isGCSEExpression(const Instruction& instr) {
+  return instr.isBinary() && instr.getOpcode() != Opcode::OR;
+}
+
+}  // namespace
+
+struct NameTable::Tables {
+  InternedNames symbols;
+  VersionedNames versions;
+};
+
+NameTable::NameTable() : tables(std::make_unique<Tables>()) {}
+
+NameTable::~NameTable() = default;
+
+NameTable& NameTable::current() {
+  static NameTable shared;
+  return scopeNames ? *scopeNames : shared;
+}
+
+uint32_t NameTable::intern(const std::string& name) {
+  auto& table = current().tables->symbols;
+  {
+    std::shared_lock lock(table.mutex);
+    auto it = table.ids.find(name);
+    if (it != table.ids.end()) {
+      return it->second;
+    }
+  }
+  std::unique_lock lock(table.mutex);
+  auto [it, added] = table.ids.emplace(name, table.names.size());
+  if (added) {
+    table.names.push_back(name);
+  }
+  return it->second;
+}
+
+const std::string& NameTable::name(uint32_t id) {
+  auto& table = current().tables->symbols;
+  std::shared_lock lock(table.mutex);
+  return table.names.at(id);
+}
+
+std::size_t NameTable::symbols() const {
+  std::shared_lock lock(tables->symbols.mutex);
+  return tables->symbols.names.size();
+}
+
+std::size_t NameTable::versions() const {
+  std::shared_lock lock(tables->versions.mutex);
+  return tables->versions.versions.size();
+}
+
+NameScope::NameScope(NameTable& table) : outer(scopeNames) {
+  scopeNames = &table;
+}
+
+NameScope::~NameScope() { scopeNames = outer; }
+
+VersionScope::VersionScope(VersionCounters& counters)
+    : outer(scopeCounters) {
+  scopeCounters = &counters;
+}
+
+VersionScope::~VersionScope() { scopeCounters = outer; }
+
+std::string Operand::GetVariableName() const {
+  assert(t_ != OperandType::Int && t_ != OperandType::None);
+  if (kind_ == NameKind::Symbol) {
+    return NameTable::name(id_);
+  }
+  if (kind_ == NameKind::Version) {
+    return base().GetVariableName() + "." + std::to_string(version());
+  }
+  return NameKindPrefix(kind_) + std::to_string(id_);
+}
+
+Operand Operand::newVersion() const {
+  auto& table = NameTable::current().tables->versions;
+  auto var = base();
+  std::unique_lock lock(table.mutex);
+  uint32_t n = ++(scopeCounters ? *scopeCounters : table.last)[var];
+  table.versions.emplace_back(var, n);
+  return Operand(NameKind::Version, table.versions.size() - 1, t_);
+}
+
+Operand Operand::base() const {
+  if (kind_ != NameKind::Version) {
+    return *this;
+  }
+  auto& table = NameTable::current().tables->versions;
+  std::shared_lock lock(table.mutex);
+  return table.versions.at(id_).first;
+}
+
+uint32_t Operand::version() const {
+  if (kind_ != NameKind::Version) {
+    return 0;
+  }
+  auto& table = NameTable::current().tables->versions;
+  std::shared_lock lock(table.mutex);
+  return table.versions.at(id_).second;
+}
+
+void Operand::print(std::ostream& os) const {
+  switch (t_) {
+    case OperandType::None:
+      return;
+    case OperandType::Int:
+      os << GetConstant();
+      return;
+    default:
+      if (kind_ == NameKind::Symbol) {
+        os << NameTable::name(id_);
+      } else if (kind_ == NameKind::Version) {
+        os << base() << "." << version();
+      } else {
+        os << NameKindPrefix(kind_) << id_;
+      }
+      if (t_ == OperandType::Label) {
+        os << ":";
+      }
+  }
+}
+
+std::string const Operand::toString() const {
+  std::ostringstream os;
+  print(os);
+  return os.str();
+}
+
+void Instruction::printExpr(std::ostream& os) const {
+  if (operand2_.GetOperandType() != OperandType::None) {
+    os << operand1_ << " " << OpcodeToString(op) << " " << operand2_;
+  } else if (op == Opcode::NIL) {
+    os << operand1_;
+  } else {
+    os << OpcodeToString(op) << " " << operand1_;
+  }
+}
+
+void Instruction::print(std::ostream& os) const {
+  if (is_label) {
+    os << operand0_;
+  } else if (operand1_.GetOperandType() == OperandType::None) {
+    // arg var, output var, return var, jump tgt
+    os << OpcodeToString(op) << " " << operand0_;
+  } else if (operand1_.GetOperandType() == OperandType::Label) {
+    // jump_if_0 op1 op2
+    os << OpcodeToString(op) << " " << operand0_ << " " << operand1_;
+  } else {
+    os << operand0_ << " <- ";
+    printExpr(os);
+  }
+}
+
+void Phi::print(std::ostream& os) const {
+  os << lhs << " <- phi(";
+  for (std::size_t i = 0; i < args.size(); ++i) {
+    os << (i ? ", " : "") << args[i];
+  }
+  os << ")";
+}
+
+ExprKey::ExprKey(Opcode op, Operand lhs, Operand rhs)
+    : op(op), lhs(lhs), rhs(rhs) {
+  if (isCommutative(op) && rhs.bits() < lhs.bits()) {
+    std::swap(this->lhs, this->rhs);
+  }
+}
+
+std::string const Instruction::toString() const {
+  std::ostringstream os;
+  print(os);
+  return os.str();
+}
+
+IR::TmpVar::TmpVar(Operand var, IR& ir) : var(var), ir(ir) {}
 IR::TmpVar::~TmpVar() {}
 
 IR::TmpVar IR::freshTmp() {
-  auto name = IRSymbolTable::tmpPrefix + std::to_string(symbolTable.nextTmp++);
-  return TmpVar(name, *this);
+  return TmpVar(
+      Operand(NameKind::Tmp, symbolTable.nextTmp++, OperandType::Var), *this);
 }
 
 std::vector<Instruction> IR::generateCFG(const Program& program) {
@@ -102,6 +323,26 @@ std::vector<Instruction> IR::generateCFG(const Program& program) {
   return insns;
 }
 
+void IR::emitBranch(const RelationalExpr& guard, Operand label, bool onTrue) {
+  branch = BranchTarget{label, onTrue};
+  guard.Visit(this);
+}
+
+std::optional<IR::BranchTarget> IR::takeBranch() {
+  auto target = branch;
+  branch.reset();
+  return target;
+}
+
+void IR::branchOn(Operand cond, const BranchTarget& target) {
+  if (target.onTrue) {
+    auto negated = freshTmp();
+    insns.push_back(Instruction(negated.getOperand(), Opcode::NOT, cond));
+    cond = negated.getOperand();
+  }
+  insns.push_back(Instruction(cond, Opcode::jump_conditional, target.label));
+}
+
 void IR::VisitIntegerExpr(const IntegerExpr& exp) {
   arg_stack.push_back(Operand(exp.value()));
 }
@@ -120,8 +361,8 @@ void IR::VisitAddExpr(const AddExpr& exp) {
   auto rhs2 = std::move(arg_stack.back());
   arg_stack.pop_back();
 
-  arg_stack.push_back(Operand(tmpVar.getName(), OperandType::Var));
-  insns.push_back(Instruction(Operand(tmpVar.getName(), OperandType::Var),
+  arg_stack.push_back(tmpVar.getOperand());
+  insns.push_back(Instruction(tmpVar.getOperand(),
                               Opcode::ADD, rhs2, rhs1));
 }
 
@@ -135,8 +376,8 @@ void IR::VisitSubtractExpr(const SubtractExpr& exp) {
   auto rhs2 = std::move(arg_stack.back());
   arg_stack.pop_back();
 
-  arg_stack.push_back(Operand(tmpVar.getName(), OperandType::Var));
-  insns.push_back(Instruction(Operand(tmpVar.getName(), OperandType::Var),
+  arg_stack.push_back(tmpVar.getOperand());
+  insns.push_back(Instruction(tmpVar.getOperand(),
                               Opcode::SUB, rhs2, rhs1));
 }
 
@@ -150,12 +391,13 @@ void IR::VisitMultiplyExpr(const MultiplyExpr& exp) {
   auto rhs2 = std::move(arg_stack.back());
   arg_stack.pop_back();
 
-  arg_stack.push_back(Operand(tmpVar.getName(), OperandType::Var));
-  insns.push_back(Instruction(Operand(tmpVar.getName(), OperandType::Var),
+  arg_stack.push_back(tmpVar.getOperand());
+  insns.push_back(Instruction(tmpVar.getOperand(),
                               Opcode::MUL, rhs2, rhs1));
 }
 
 void IR::VisitLessThanExpr(const LessThanExpr& exp) {
+  auto target = takeBranch();
   auto tmpVar = freshTmp();
   exp.lhs().Visit(this);
   exp.rhs().Visit(this);
@@ -165,12 +407,24 @@ void IR::VisitLessThanExpr(const LessThanExpr& exp) {
   auto rhs2 = std::move(arg_stack.back());
   arg_stack.pop_back();
 
-  arg_stack.push_back(Operand(tmpVar.getName(), OperandType::Var));
-  insns.push_back(Instruction(Operand(tmpVar.getName(), OperandType::Var),
+  if (target && target->onTrue) {
+    // a < b holds iff b <= a does not
+    insns.push_back(Instruction(tmpVar.getOperand(), Opcode::LE, rhs1, rhs2));
+    insns.push_back(Instruction(tmpVar.getOperand(), Opcode::jump_conditional,
+                                target->label));
+    return;
+  }
+  insns.push_back(Instruction(tmpVar.getOperand(),
                               Opcode::LT, rhs2, rhs1));
+  if (target) {
+    branchOn(tmpVar.getOperand(), *target);
+  } else {
+    arg_stack.push_back(tmpVar.getOperand());
+  }
 }
 
 void IR::VisitLessThanEqualToExpr(const LessThanEqualToExpr& exp) {
+  auto target = takeBranch();
   auto tmpVar = freshTmp();
   exp.lhs().Visit(this);
   exp.rhs().Visit(this);
@@ -180,12 +434,24 @@ void IR::VisitLessThanEqualToExpr(const LessThanEqualToExpr& exp) {
   auto rhs2 = std::move(arg_stack.back());
   arg_stack.pop_back();
 
-  arg_stack.push_back(Operand(tmpVar.getName(), OperandType::Var));
-  insns.push_back(Instruction(Operand(tmpVar.getName(), OperandType::Var),
+  if (target && target->onTrue) {
+    // a <= b holds iff b < a does not
+    insns.push_back(Instruction(tmpVar.getOperand(), Opcode::LT, rhs1, rhs2));
+    insns.push_back(Instruction(tmpVar.getOperand(), Opcode::jump_conditional,
+                                target->label));
+    return;
+  }
+  insns.push_back(Instruction(tmpVar.getOperand(),
                               Opcode::LE, rhs2, rhs1));
+  if (target) {
+    branchOn(tmpVar.getOperand(), *target);
+  } else {
+    arg_stack.push_back(tmpVar.getOperand());
+  }
 }
 
 void IR::VisitEqualToExpr(const EqualToExpr& exp) {
+  auto target = takeBranch();
   auto tmpVar = freshTmp();
   exp.lhs().Visit(this);
   exp.rhs().Visit(this);
@@ -195,12 +461,28 @@ void IR::VisitEqualToExpr(const EqualToExpr& exp) {
   auto rhs2 = std::move(arg_stack.back());
   arg_stack.pop_back();
 
-  arg_stack.push_back(Operand(tmpVar.getName(), OperandType::Var));
-  insns.push_back(Instruction(Operand(tmpVar.getName(), OperandType::Var),
+  insns.push_back(Instruction(tmpVar.getOperand(),
                               Opcode::EQ, rhs2, rhs1));
+  if (target) {
+    branchOn(tmpVar.getOperand(), *target);
+  } else {
+    arg_stack.push_back(tmpVar.getOperand());
+  }
 }
 
 void IR::VisitLogicalAndExpr(const LogicalAndExpr& exp) {
+  if (auto target = takeBranch()) {
+    if (!target->onTrue) {
+      emitBranch(exp.lhs(), target->label, false);
+      emitBranch(exp.rhs(), target->label, false);
+      return;
+    }
+    auto skip = Operand(NameKind::Guard, freshIndex(), OperandType::Label);
+    emitBranch(exp.lhs(), skip, false);
+    emitBranch(exp.rhs(), target->label, true);
+    insns.push_back(skip);
+    return;
+  }
   auto tmpVar = freshTmp();
   exp.lhs().Visit(this);
   exp.rhs().Visit(this);
@@ -210,12 +492,24 @@ void IR::VisitLogicalAndExpr(const LogicalAndExpr& exp) {
   auto rhs2 = std::move(arg_stack.back());
   arg_stack.pop_back();
 
-  arg_stack.push_back(Operand(tmpVar.getName(), OperandType::Var));
-  insns.push_back(Instruction(Operand(tmpVar.getName(), OperandType::Var),
+  arg_stack.push_back(tmpVar.getOperand());
+  insns.push_back(Instruction(tmpVar.getOperand(),
                               Opcode::AND, rhs2, rhs1));
 }
 
 void IR::VisitLogicalOrExpr(const LogicalOrExpr& exp) {
+  if (auto target = takeBranch()) {
+    if (target->onTrue) {
+      emitBranch(exp.lhs(), target->label, true);
+      emitBranch(exp.rhs(), target->label, true);
+      return;
+    }
+    auto skip = Operand(NameKind::Guard, freshIndex(), OperandType::Label);
+    emitBranch(exp.lhs(), skip, true);
+    emitBranch(exp.rhs(), target->label, false);
+    insns.push_back(skip);
+    return;
+  }
   auto tmpVar = freshTmp();
   exp.lhs().Visit(this);
   exp.rhs().Visit(this);
@@ -225,20 +519,24 @@ void IR::VisitLogicalOrExpr(const LogicalOrExpr& exp) {
   auto rhs2 = std::move(arg_stack.back());
   arg_stack.pop_back();
 
-  arg_stack.push_back(Operand(tmpVar.getName(), OperandType::Var));
-  insns.push_back(Instruction(Operand(tmpVar.getName(), OperandType::Var),
+  arg_stack.push_back(tmpVar.getOperand());
+  insns.push_back(Instruction(tmpVar.getOperand(),
                               Opcode::OR, rhs2, rhs1));
 }
 
 void IR::VisitLogicalNotExpr(const LogicalNotExpr& exp) {
+  if (auto target = takeBranch()) {
+    emitBranch(exp.operand(), target->label, !target->onTrue);
+    return;
+  }
   auto tmpVar = freshTmp();
   exp.operand().Visit(this);
 
   auto rhs1 = std::move(arg_stack.back());
   arg_stack.pop_back();
 
-  arg_stack.push_back(Operand(tmpVar.getName(), OperandType::Var));
-  insns.push_back(Instruction(Operand(tmpVar.getName(), OperandType::Var),
+  arg_stack.push_back(tmpVar.getOperand());
+  insns.push_back(Instruction(tmpVar.getOperand(),
                               Opcode::NOT, rhs1));
 }
 
@@ -275,16 +573,20 @@ void IR::VisitAssignmentExpr(const Assignment& assignment) {
 }
 
 void IR::VisitConditionalExpr(const Conditional& conditional) {
-  auto n = std::to_string(freshIndex());
-  auto falseLabel = Operand("IF_FALSE_" + n, OperandType::Label);
-  auto endLabel = Operand("IF_END_" + n, OperandType::Label);
+  auto n = freshIndex();
+  auto falseLabel = Operand(NameKind::IfFalse, n, OperandType::Label);
+  auto endLabel = Operand(NameKind::IfEnd, n, OperandType::Label);
 
-  conditional.guard().Visit(this);
-  auto guard_expr = arg_stack.back();
-  arg_stack.pop_back();
+  if (shortCircuit) {
+    emitBranch(conditional.guard(), falseLabel, false);
+  } else {
+    conditional.guard().Visit(this);
+    auto guard_expr = arg_stack.back();
+    arg_stack.pop_back();
 
-  insns.push_back(
-      Instruction(guard_expr, Opcode::jump_conditional, falseLabel));
+    insns.push_back(
+        Instruction(guard_expr, Opcode::jump_conditional, falseLabel));
+  }
   conditional.true_branch().Visit(this);
 
   insns.push_back(Instruction(Opcode::jump_unconditional, endLabel));
@@ -295,17 +597,22 @@ void IR::VisitConditionalExpr(const Conditional& conditional) {
 }
 
 void IR::VisitLoopExpr(const Loop& loop) {
-  auto n = std::to_string(freshIndex());
-  auto startLabel = Operand("WHILE_START_" + n, OperandType::Label);
-  auto endLabel = Operand("WHILE_END_" + n, OperandType::Label);
+  auto n = freshIndex();
+  auto startLabel = Operand(NameKind::WhileStart, n, OperandType::Label);
+  auto endLabel = Operand(NameKind::WhileEnd, n, OperandType::Label);
 
   insns.push_back(startLabel);
-  loop.guard().Visit(this);
+  if (shortCircuit) {
+    emitBranch(loop.guard(), endLabel, false);
+  } else {
+    loop.guard().Visit(this);
 
-  auto guard_expr = arg_stack.back();
-  arg_stack.pop_back();
+    auto guard_expr = arg_stack.back();
+    arg_stack.pop_back();
 
-  insns.push_back(Instruction(guard_expr, Opcode::jump_conditional, endLabel));
+    insns.push_back(
+        Instruction(guard_expr, Opcode::jump_conditional, endLabel));
+  }
 
   loop.body().Visit(this);
 
@@ -340,6 +647,10 @@ void IR::VisitProgramExpr(const Program& program) {
 
     auto bb = getBB(insns);
     program_blocks[fnDef->function_name()] = bb;
+    auto& params = program_params[fnDef->function_name()];
+    for (const auto& param : fnDef->parameters()) {
+      params.push_back(Operand(param.second->name(), OperandType::Var));
+    }
 
     insns.clear();
     arg_stack.clear();
@@ -361,7 +672,17 @@ void IR::VisitProgramExpr(const Program& program) {
   program_blocks["global"] = bb;
 }
 
-std::vector<int> IR::getLeaders(std::vector<Instruction> insns) {
+Module IR::buildModule() {
+  Module module;
+  for (auto& [name, blocks] : program_blocks) {
+    module.functions[name] = std::make_unique<CFG>(std::move(blocks));
+  }
+  module.params = program_params;
+  program_blocks.clear();
+  return module;
+}
+
+std::vector<int> IR::getLeaders(const std::vector<Instruction>& insns) {
   std::vector<int> leaders;
   assert(!(insns.empty()));
   assert(leaders.empty());
@@ -385,131 +706,118 @@ std::vector<int> IR::getLeaders(std::vector<Instruction> insns) {
   return leaders;
 }
 
-std::vector<BasicBlock> IR::getBB(std::vector<Instruction> insns) {
+std::vector<BasicBlock> IR::getBB(const std::vector<Instruction>& insns) {
   std::vector<BasicBlock> basic_blocks;
   auto leaders = getLeaders(insns);
+  basic_blocks.reserve(leaders.size());
   for (auto it = leaders.begin(); it != leaders.end(); ++it) {
-    std::vector<Instruction> instr;
-    std::set<int> succ;
-    uint32_t beginning = *it;
-    uint32_t end;
-    if (std::next(it) != leaders.end()) {
-      end = (*std::next(it) - 1);
-    } else {
-      end = insns.size() - 1;
-    }
-    // one line long blocks
-    for (std::size_t i = beginning; i <= end; ++i) {
-      instr.push_back(insns[i]);
+    auto beginning = insns.begin() + *it;
+    auto end = std::next(it) != leaders.end() ? insns.begin() + *std::next(it)
+                                              : insns.end();
+    // blockID is the number of the instruction overall, just needs to be
+    // unique
+    basic_blocks.push_back(
+        BasicBlock(std::vector<Instruction>(beginning, end), *it));
+  }
+  return basic_blocks;
+}
+
+// Successors are the target of the jump ending a block and, unless the
+// block ends in an unconditional jump, return or output, the next block.
+// Both edge lists are built as offset arrays into a single vector;
+// predecessors are filled in block order, so each list comes out sorted.
+void CFG::buildEdges() {
+  auto n = basic_blocks.size();
+  IndexTable<Operand, OperandHash> labels(n);
+  std::vector<int> labelBlock;
+  for (std::size_t b = 0; b < n; ++b) {
+    const auto& instrs = basic_blocks[b].instructions();
+    if (!instrs.empty() && instrs.front().getLabel()) {
+      labels.insert(instrs.front().getLabel().value());
+      labelBlock.resize(labels.size(), b);
     }
+  }
 
-    // // successor sets
-    // jumps
-    auto ins = insns[end];
-    if (ins.getOpcode() == Opcode::jump_unconditional ||
-        ins.getOpcode() == Opcode::jump_conditional) {
-      auto jump_edge = ins.getJumpTarget();
-
-      for (auto lit = leaders.begin(); lit != leaders.end(); ++lit) {
-        if (insns[*lit].getLabel() &&
-            insns[*lit].getLabel().value().toString() == jump_edge.toString()) {
-          auto leaders_idx = std::distance(leaders.begin(), lit);
-          succ.insert(leaders_idx);
-        }
+  succOffsets.assign(n + 1, 0);
+  succEdges.clear();
+  for (std::size_t b = 0; b < n; ++b) {
+    const auto& instrs = basic_blocks[b].instructions();
+    int first = succEdges.size();
+    if (!instrs.empty() &&
+        (instrs.back().getOpcode() == Opcode::jump_unconditional ||
+         instrs.back().getOpcode() == Opcode::jump_conditional)) {
+      int label = labels.find(instrs.back().getJumpTarget());
+      if (label >= 0) {
+        succEdges.push_back(labelBlock[label]);
       }
     }
-    // everything else
-    if (ins.getOpcode() != Opcode::jump_unconditional) {
-      if (std::next(it) != leaders.end()) {
-        auto leaders_idx = std::distance(leaders.begin(), std::next(it));
-        succ.insert(leaders_idx);
-      }
+    if ((instrs.empty() || !instrs.back().endsFallthrough()) && b + 1 < n) {
+      succEdges.push_back(b + 1);
     }
-    basic_blocks.push_back(BasicBlock(
-        instr, succ, *it));  // blockID is the number of the instruction
-                             // overall, just needs to be unique
+    std::sort(succEdges.begin() + first, succEdges.end());
+    succEdges.erase(std::unique(succEdges.begin() + first, succEdges.end()),
+                    succEdges.end());
+    succOffsets[b + 1] = succEdges.size();
   }
 
-  // predecessors
-  for (auto b = basic_blocks.begin(); b != basic_blocks.end(); ++b) {
-    auto curr_idx = std::distance(basic_blocks.begin(), b);
-    auto curr_succ = b->getSuccessors();
-    for (auto s = curr_succ.begin(); s != curr_succ.end(); ++s) {
-      basic_blocks[*s].insertPredecessor(curr_idx);
+  predOffsets.assign(n + 1, 0);
+  for (int succ : succEdges) {
+    ++predOffsets[succ + 1];
+  }
+  for (std::size_t b = 0; b < n; ++b) {
+    predOffsets[b + 1] += predOffsets[b];
+  }
+  predEdges.resize(succEdges.size());
+  std::vector<int> fill(predOffsets.begin(), predOffsets.end() - 1);
+  for (std::size_t b = 0; b < n; ++b) {
+    for (int succ : successors(b)) {
+      predEdges[fill[succ]++] = b;
     }
   }
-
-  return basic_blocks;
 }
 
-std::pair<std::vector<bool>, std::vector<bool>> CFG::computeGenKill(
-    BasicBlock block) {
-  std::vector<bool> gen(allExprs.size(), false);
-  std::vector<bool> kill(allExprs.size(), false);
-  auto instrs = block.instructions();
-
-  // gen
-  for (auto instr = instrs.cbegin(); instr != instrs.cend(); ++instr) {
-    if (instr->isBinary()) {
-      auto lhs = instr->getOperand0();
-      auto rhs1 = instr->getOperand1();
-      auto rhs2 = instr->getOperand2();
-
-      // no immediate conflict, try next instruction
-      if (lhs.toString() != rhs1.toString() ||
-          lhs.toString() != rhs2.toString()) {
-        auto next_instr = std::next(instr);
-        if (next_instr == instrs.cend()) {
-          // we made it to the end, we can relax
-          std::string s = instr->toString();
-          std::string delimiter = "<-";
-          auto pos = s.find(delimiter);
-          std::string expr;
-          if (pos != std::string::npos) {
-            expr = s.substr(pos + 3, s.length());
-            gen[legend[expr]] = true;
-          }
-        }
-
-        for (auto remainder = next_instr; remainder != instrs.cend();
-             ++remainder) {
-          auto nxt = (remainder->getOperand0()).toString();
-          if (nxt == rhs1.toString() || nxt == rhs1.toString()) {
-            break;
-          } else if (std::next(remainder) == instrs.cend()) {
-            // we made it to the end, we can relax
-            std::string s = instr->toString();
-            std::string delimiter = "<-";
-            auto pos = s.find(delimiter);
-            std::string expr;
-            if (pos != std::string::npos) {
-              expr = s.substr(pos + 3, s.length());
-              gen[legend[expr]] = true;
-            }
-          }
-        }
+// One backward pass over the block. An expression is generated if it is
+// computed and none of its operands is redefined later in the block (or by
+// the computing instruction itself); every definition kills the expressions
+// that use the defined variable, found through the exprsUsingVar index.
+BitVectorPair CFG::computeGenKill(const BasicBlock& block) {
+  BitVector gen(allExprs.size());
+  BitVector kill(allExprs.size());
+  const auto& instrs = block.instructions();
+
+  // definedStamp[v] == stamp iff v is defined later in this block
+  ++stamp;
+  auto definedLater = [&](const Operand& operand) {
+    int v = exprVars.find(operand);
+    return v >= 0 && definedStamp[v] == stamp;
+  };
+
+  for (auto instr = instrs.crbegin(); instr != instrs.crend(); ++instr) {
+    if (!instr->isDefinition()) {
+      continue;
+    }
+    auto lhs = instr->getOperand0();
+    if (isGCSEExpression(*instr)) {
+      auto key = ExprKey::of(*instr);
+      if (!definedLater(key.lhs) && !definedLater(key.rhs) && !key.uses(lhs)) {
+        gen.set(legend.find(key));
       }
     }
-  }
-
-  // kill
-  for (auto instr = instrs.cbegin(); instr != instrs.cend(); ++instr) {
-    if (instr->isUnary() || instr->isBinary() || instr->isSSA()) {
-      auto lhs = (instr->getOperand0()).toString();
-      for (auto l = legend.cbegin(); l != legend.cend(); ++l) {
-        if ((l->first).find(lhs) != std::string::npos) {
-          kill[l->second] = true;
-        }
+    int v = exprVars.find(lhs);
+    if (v >= 0 && definedStamp[v] != stamp) {
+      definedStamp[v] = stamp;
+      for (int e : exprsUsingVar[v]) {
+        kill.set(e);
       }
     }
   }
 
-  return std::make_pair(gen, kill);
+  return std::make_pair(std::move(gen), std::move(kill));
 }
 
-std::vector<std::pair<std::vector<bool>, std::vector<bool>>>
+std::vector<BitVectorPair>
 CFG::getAllGenKill() {
-  std::vector<std::pair<std::vector<bool>, std::vector<bool>>> genkill;
+  std::vector<BitVectorPair> genkill;
   for (auto block = basic_blocks.cbegin(); block != basic_blocks.cend();
        ++block) {
     auto genkill_pair = computeGenKill(*block);
@@ -518,98 +826,73 @@ CFG::getAllGenKill() {
   return genkill;
 }
 
+// Expressions are numbered in order of first occurrence, which fixes the
+// order of the bits of the dataflow sets. The _optN holding expression e is
+// instead numbered by the rank of e's text ("a ADD b") in lexicographic
+// order, as in the expected outputs in tests/.
 void CFG::getAllExpressions() {
-  std::map<std::string, int> map_legend;
-  int ctr = 0;
+  legend.clear();
+  exprVars.clear();
+  exprsUsingVar.clear();
+  std::vector<std::string> text;
   for (auto block = basic_blocks.cbegin(); block != basic_blocks.cend();
        ++block) {
     for (auto instr = block->instructions().cbegin();
          instr != block->instructions().cend(); ++instr) {
-      // we only care about binary expressions
-      if (instr->isBinary()) {
-        std::string s = instr->toString();
-        std::string delimiter = "<-";
-        auto pos = s.find(delimiter);
-        std::string expr;
-        if (pos != std::string::npos) {
-          expr = s.substr(pos + 3, s.length());
-          if (map_legend.find(expr) == map_legend.end()) {
-            map_legend[expr] = ctr;
-            ++ctr;
-          }
+      if (!isGCSEExpression(*instr)) {
+        continue;
+      }
+      auto key = ExprKey::of(*instr);
+      auto size = legend.size();
+      int e = legend.insert(key);
+      if (legend.size() == size) {
+        continue;
+      }
+      std::ostringstream os;
+      instr->printExpr(os);
+      text.push_back(os.str());
+      // index the new expression under each variable it uses
+      for (auto operand : {key.lhs, key.rhs}) {
+        if (operand.GetOperandType() != OperandType::Var) {
+          continue;
+        }
+        std::size_t v = exprVars.insert(operand);
+        if (v == exprsUsingVar.size()) {
+          exprsUsingVar.emplace_back();
+        }
+        if (exprsUsingVar[v].empty() || exprsUsingVar[v].back() != e) {
+          exprsUsingVar[v].push_back(e);
         }
       }
     }
   }
-  std::vector<bool> E(map_legend.size(), false);
-  legend = map_legend;
-  allExprs = E;
-}
-
-
-
-std::vector<bool> intersect(std::vector<bool> a, std::vector<bool> b) {
-  if (a.size() != b.size()) {
-    std::cout << "vectors not same size" << std::endl;
-  }
-  std::vector<bool> output;
-  for (int i = 0; i < a.size(); i++) {
-    bool out = a.at(i) & b.at(i);
-    output.push_back(out);
-  }
-  return output;
-}
-
-std::vector<bool> unionop(std::vector<bool> a, std::vector<bool> b) {
-  if (a.size() != b.size()) {
-    std::cout << "vectors not same size" << std::endl;
-  }
-  std::vector<bool> output;
-  for (int i = 0; i < a.size(); i++) {
-    bool out = a.at(i) | b.at(i);
-    output.push_back(out);
-  }
-  return output;
-}
-
-std::vector<bool> subtract(std::vector<bool> a, std::vector<bool> b) {
-  if (a.size() != b.size()) {
-    std::cout << "vectors not same size" << std::endl;
-  }
-  for (int i = 0; i < a.size(); i++) {
-    if(a.at(i) & b.at(i)) {
-      a.at(i) = false;
-    }
+  std::vector<int> order(legend.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&](int a, int b) { return text[a] < text[b]; });
+  optIds.resize(order.size());
+  for (std::size_t rank = 0; rank < order.size(); ++rank) {
+    optIds[order[rank]] = rank;
   }
-  return a;
+  allExprs = BitVector(legend.size());
+  definedStamp.assign(exprVars.size(), 0);
+  stamp = 0;
 }
 
-
-
-
-
-
 // writes to availableExpressions
-void CFG::runWorklist(
-    const std::vector<std::pair<std::vector<bool>, std::vector<bool>>>&
-        genkill) {
-          for (int i = 0; i < availableExpressions.size(); i++) {
-            std::set<int> pre = basic_blocks.at(i).getPredecessors();
-            std::set<int>::iterator it;
-            for (it = pre.begin(); it != pre.end(); ++it) {
-                int f = *it; // Note the "*" here
-                availableExpressions.at(i).first = intersect(availableExpressions.at(i).first,availableExpressions.at(f).second);
-            }
-            auto temp = subtract(availableExpressions.at(i).first,genkill.at(i).second);
-            temp = unionop(temp,genkill.at(i).first);
-            availableExpressions.at(i).second = temp;
-          }
-  // fill me in
+void CFG::runWorklist(const std::vector<BitVectorPair>& genkill) {
+  DataflowAnalysis<BitVector, Forward, IntersectMeet,
+                   GenKillTransfer<BitVector>>
+      analysis(*this, BitVector(allExprs.size()),
+               BitVector(allExprs.size(), true), {genkill});
+  analysis.run();
+  availableExpressions = std::move(analysis.results());
+  worklistIterations = analysis.iterations();
 }
 
 Instruction makeinstr(int index, Instruction parent) {
-  std::string var = "_opt" + std::to_string(index);
-  Instruction a(Operand(var, OperandType::Var), parent.getOperand0());
+  Instruction a(Operand(NameKind::Opt, index, OperandType::Var),
+                parent.getOperand0());
   return a;
 }
 
@@ -617,104 +900,68 @@ void BasicBlock::setinstruction(int index, Instruction a) {
   instructions_.at(index) = a;
 }
 
-
 void BasicBlock::addstatement(int index, Instruction input) {
-  instructions_.insert(instructions_.begin() + index,input);
+  instructions_.insert(instructions_.begin() + index, input);
 }
 
-bool CFG::checkifkilled(int blocknumber, int index, Instruction available) {
-  std::cout << "Enter crazy" << std::endl;
-  for (int i = 0; i < index-1; i++) {
-    std::cout << "checking if i'm dead" << std::endl;
-    if (available.isUnary() || available.isBinary()) {
-      if (optimized_program.at(blocknumber).instructions().at(i).getOperand0().toString().compare(available.getOperand1().toString()) == 0) {
-        return true;
-      }
+// Whether an operand of available is redefined by one of the first index
+// instructions of the block being rewritten
+bool checkifkilled(const std::vector<Instruction>& block, int index,
+                   const Instruction& available) {
+  for (int i = 0; i < index; i++) {
+    if (block[i].isLabel() || !block[i].isDefinition()) {
+      continue;
     }
-    if (available.isBinary()) {
-      if (optimized_program.at(blocknumber).instructions().at(i).getOperand0().toString().compare(available.getOperand2().toString()) == 0) {
-        return true;
-      }
+    auto def = block[i].getOperand0();
+    if ((available.isUnary() || available.isBinary()) &&
+        def == available.getOperand1()) {
+      return true;
+    }
+    if (available.isBinary() && def == available.getOperand2()) {
+      return true;
     }
   }
   return false;
 }
 
-void CFG::optimize(int blocknumber, int index, int available) {
-  if (availableExpressions.at(blocknumber).first.at(available) == false) {
-    return;
-  }
-  std::cout << "so good" << std::endl;
-  if (availableExpressions.at(blocknumber).second.at(available) == true) {
-    std::cout << "Am I dead yet" << std::endl;
-    std::cout << optimized_program.at(blocknumber).instructions().size() << std::endl;
-    std::cout << index << std::endl;
-    if (checkifkilled(blocknumber,index,optimized_program.at(blocknumber).instructions().at(index))) {
-      return;
+// Every computation of expression e is followed by a copy of its result
+// into the _optN of e, so on entry to a block where e is available that
+// _optN holds its value. A computation reads it instead as long as no
+// earlier instruction of the block has redefined an operand of e.
+bool CFG::computeGCSE() {
+  bool replaced = false;
+  for (std::size_t i = 0; i < basic_blocks.size(); i++) {
+    const auto& in = availableExpressions[i].first;
+    const auto& instrs = basic_blocks[i].instructions();
+    std::vector<Instruction> optimized;
+    optimized.reserve(instrs.size() * 2);
+    for (const auto& instr : instrs) {
+      int expr =
+          isGCSEExpression(instr) ? legend.find(ExprKey::of(instr)) : -1;
+      if (expr < 0) {
+        optimized.push_back(instr);
+        continue;
+      }
+      int index = optimized.size();
+      int opt = optIds[expr];
+      if (in.test(expr) && !checkifkilled(optimized, index, instr)) {
+        optimized.push_back(
+            Instruction(instr.getOperand0(),
+                        Operand(NameKind::Opt, opt, OperandType::Var)));
+        replaced = true;
+      } else {
+        optimized.push_back(instr);
+      }
+      optimized.push_back(makeinstr(opt, instr));
     }
+    basic_blocks[i].setInstructions(std::move(optimized));
   }
-  std::cout << "Trace" << std::endl;
-  std::string var = "_opt" + std::to_string(index);
-  Instruction a(optimized_program.at(blocknumber).instructions().at(index).getOperand0(),Operand(var, OperandType::Var));
-  optimized_program.at(blocknumber).setinstruction(index,a);
-}
-
-
-
-std::vector<BasicBlock> CFG::computeGCSE(
-    const std::vector<std::pair<std::vector<bool>, std::vector<bool>>>&
-        genkill) {
-          std::cout << "I'm in now!" << std::endl;
-          optimized_program = basic_blocks;
-          for (int i = 0; i < basic_blocks.size(); i++) {
-            int index = 0;
-            std::cout << "begin outter loop" << std::endl;
-            for (int j = 0; j < basic_blocks.at(i).instructions().size(); j++) {
-              std::cout << "being inner" << std::endl;
-              std::string compare = "";
-              if (basic_blocks.at(i).instructions().at(j).isUnary() || basic_blocks.at(i).instructions().at(j).isBinary()) {
-                compare = compare + basic_blocks.at(i).instructions().at(j).getOperand1().toString();
-              }
-              compare = compare + " " + OpcodeToString(basic_blocks.at(i).instructions().at(j).getOpcode());
-              if (basic_blocks.at(i).instructions().at(j).isBinary()) {
-                compare = compare + " " + basic_blocks.at(i).instructions().at(j).getOperand2().toString();
-              }
-              if (legend.find(compare) != legend.end()) {
-                std::cout << "Before optimize" << std::endl;
-                optimize(i,index,legend.find(compare)->second);
-                std::cout << "go on" << std::endl;
-                index++;
-                Instruction a = makeinstr(legend.find(compare)->second,basic_blocks.at(i).instructions().at(j));
-                optimized_program.at(i).addstatement(index,a);
-                std::cout << "after optimize" << std::endl;
-              }
-              index++;
-              std::cout << "end inner" << std::endl;
-            }
-            std::cout << "end outter loop" << std::endl;
-          }
-          return optimized_program;
-  // fill me in
-}
-
-
-void CFG::resetAvailExprs(const std::vector<std::pair<std::vector<bool>, std::vector<bool>>>& genkill) {
-  //assume all vector sizes internally are same
-  int size = genkill.size();
-  availableExpressions = genkill;
-  std::fill(availableExpressions.at(0).first.begin(), availableExpressions.at(0).first.end(), false);
-  std::fill(availableExpressions.at(0).second.begin(), availableExpressions.at(0).second.end(), true);
-  for (int i = 1; i < size; i++) {
-    std::fill(availableExpressions.at(i).first.begin(), availableExpressions.at(i).first.end(), true);
-    std::fill(availableExpressions.at(i).second.begin(), availableExpressions.at(i).second.end(), true);
-  }
+  return replaced;
 }
 
 void CFG::computeAvailExprs() {
-  std::cout << "I'm in 2" << std::endl;
   getAllExpressions();
   auto genkill = getAllGenKill();
-  resetAvailExprs(genkill);
   runWorklist(genkill);
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <assert.h>
+#include <stdint.h>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -8,9 +9,13 @@
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include "frontend/ast.h"
 #include "frontend/ast_visitor.h"
+#include "midend/bitvector.h"
+#include "midend/index_table.h"
 
 using namespace cs160::frontend;
 
@@ -39,46 +44,173 @@ enum class Opcode {
   NIL
 };
 
-enum class OperandType {
+enum class OperandType : uint8_t {
   Var,
   Int,
   Label,
-  Function  // since we're not using a symbol table we need to be a bit
-            // underhanded
+  Function,  // since we're not using a symbol table we need to be a bit
+             // underhanded
+  None       // default constructed, unused operand slot
+};
+
+// How the 32-bit id of a named operand is turned back into text. Symbols are
+// interned in the NameTable; the other kinds are compiler generated names
+// that are only ever formatted when printed, e.g. {Tmp, 3} prints as _tmp3.
+// Version ids index the table of SSA versions, see Operand::newVersion.
+enum class NameKind : uint8_t {
+  Symbol,
+  Tmp,
+  Opt,
+  IfFalse,
+  IfEnd,
+  WhileStart,
+  WhileEnd,
+  Version,
+  Split,
+  Pre,
+  Preheader,
+  Induction,
+  Inline,
+  TailStart,
+  Accumulator,
+  Guard
 };
 
 const std::string OpcodeToString(Opcode op_);
 
+// Value of a binary (or, ignoring rhs, NOT) instruction on constants, with
+// the wrap-around 32-bit arithmetic of the target: relational and logical
+// operators produce 0 or 1
+int EvaluateOpcode(Opcode op, int lhs, int rhs);
+
+// Side table owning the spelling of every interned symbol (program variables,
+// function names and any names made up by later passes) and the SSA
+// versions of Operand::newVersion. Operands only carry the id, the string is
+// resolved when printing. Operands use the table of the innermost NameScope
+// on their thread, or one shared by the whole process outside any scope, so
+// a compilation unit with its own table frees its names along with it.
+// Safe to use from several threads.
+class NameTable {
+ public:
+  NameTable();
+  ~NameTable();
+  NameTable(const NameTable&) = delete;
+  NameTable& operator=(const NameTable&) = delete;
+
+  // The table operands on this thread use
+  static NameTable& current();
+  static uint32_t intern(const std::string& name);
+  static const std::string& name(uint32_t id);
+
+  // Symbols and SSA versions held
+  std::size_t symbols() const;
+  std::size_t versions() const;
+
+ private:
+  friend class Operand;
+  struct Tables;
+  std::unique_ptr<Tables> tables;
+};
+
+// While alive, operands made or printed on the constructing thread use
+// table instead of the table current before. Scopes nest.
+class NameScope {
+ public:
+  explicit NameScope(NameTable& table);
+  ~NameScope();
+  NameScope(const NameScope&) = delete;
+  NameScope& operator=(const NameScope&) = delete;
+
+ private:
+  NameTable* outer;
+};
+
+// An operand is a kind tag plus a 32-bit payload: the constant itself for
+// OperandType::Int, otherwise an id whose meaning depends on the NameKind.
 class Operand {
  public:
   Operand() {}
-  Operand(int constant) : t_(OperandType::Int), constant_(constant) {
-    repr = std::to_string(constant_);
-  }
-  Operand(std::string var_name, OperandType t) : t_(t), var_name_(var_name) {
-    if (t == OperandType::Label) {
-      repr = var_name + ":";
-    } else {
-      repr = var_name;
-    }
-  }
+  Operand(int constant)
+      : t_(OperandType::Int), id_(static_cast<uint32_t>(constant)) {}
+  Operand(const std::string& var_name, OperandType t)
+      : t_(t), id_(NameTable::intern(var_name)) {}
+  Operand(NameKind kind, uint32_t n, OperandType t)
+      : t_(t), kind_(kind), id_(n) {}
+
   OperandType GetOperandType() const { return t_; }
+  NameKind GetNameKind() const { return kind_; }
   int GetConstant() const {
     assert(t_ == OperandType::Int);
-    return constant_;
+    return static_cast<int>(id_);
   }
-  std::string GetVariableName() const {
-    assert(t_ != OperandType::Int);
-    return var_name_;
+  std::string GetVariableName() const;
+  uint32_t GetId() const { return id_; }
+
+  // All fields packed into one word, for hashing and cheap comparisons
+  uint64_t bits() const {
+    return (static_cast<uint64_t>(t_) << 40) |
+           (static_cast<uint64_t>(kind_) << 32) | id_;
   }
+  bool operator==(const Operand& rhs) const { return bits() == rhs.bits(); }
+  // _tmpN, _optN, _preN, _ivN and _accN variables and SSA versions: names
+  // made up by the compiler, which it is free to remove
+  bool isTemporary() const {
+    return t_ == OperandType::Var &&
+           (kind_ == NameKind::Tmp || kind_ == NameKind::Opt ||
+            kind_ == NameKind::Version || kind_ == NameKind::Pre ||
+            kind_ == NameKind::Induction || kind_ == NameKind::Accumulator);
+  }
+
+  // A fresh SSA version of this variable, printed as x.1, x.2, ... Versions
+  // are numbered per variable across the current NameTable, or across the
+  // function of the current VersionScope, so they never clash between
+  // passes.
+  Operand newVersion() const;
+  // The variable this is a version of, the operand itself if unversioned
+  Operand base() const;
+  // 0 for unversioned operands
+  uint32_t version() const;
+  bool operator!=(const Operand& rhs) const { return !operator==(rhs); }
 
-  std::string const toString() const { return repr; }
+  void print(std::ostream& os) const;
+  std::string const toString() const;
 
  private:
-  std::string repr;
-  OperandType t_;
-  std::string var_name_;
-  int constant_;
+  OperandType t_ = OperandType::None;
+  NameKind kind_ = NameKind::Symbol;
+  uint32_t id_ = 0;
+};
+
+static_assert(sizeof(Operand) == 8, "operands should fit in a single word");
+
+struct OperandHash {
+  uint64_t operator()(const Operand& operand) const {
+    return mixBits(operand.bits());
+  }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Operand& operand) {
+  operand.print(os);
+  return os;
+}
+
+// The last version newVersion handed out for each variable
+using VersionCounters = std::unordered_map<Operand, uint32_t, OperandHash>;
+
+// While alive, newVersion on the constructing thread numbers versions with
+// counters, normally those of the function being rewritten, instead of the
+// counters shared by the whole program. The names a function ends up with
+// then only depend on the passes run over it, not on what other threads do
+// in the meantime. Scopes nest.
+class VersionScope {
+ public:
+  explicit VersionScope(VersionCounters& counters);
+  ~VersionScope();
+  VersionScope(const VersionScope&) = delete;
+  VersionScope& operator=(const VersionScope&) = delete;
+
+ private:
+  VersionCounters* outer;
 };
 
 // "<-" operator implicit
@@ -89,38 +221,29 @@ class Instruction {
         op(op),
         operand1_(rhs1),
         operand2_(rhs2),
-        is_label(false) {
-    repr = operand0_.toString() + " <- " + operand1_.toString() + " " +
-           OpcodeToString(op) + " " + operand2_.toString();
-  }  // binops
+        is_label(false) {}  // binops
   Instruction(Operand lhs, Opcode op, Operand rhs1)
       : operand0_(lhs), op(op), operand1_(rhs1), operand2_(), is_label(false) {
-    if (operand1_.GetOperandType() == OperandType::Label) {
-      repr = OpcodeToString(op) + " " + operand0_.toString() + " " +
-             operand1_.toString();
-    } else {
-      repr = operand0_.toString() + " <- " + OpcodeToString(op) + " " +
-             operand1_.toString();
-    }
   }  // var <- NOT var, var <- CALL foo, but also jump_if_0 op1 op2
   Instruction(Opcode opc, Operand rhs1)
       : operand0_(rhs1), op(opc), operand1_(), operand2_(), is_label(false) {
-    repr = OpcodeToString(op) + " " + operand0_.toString();
   }  // arg var, output var, return var, jump tgt
   Instruction(Operand lhs, Operand rhs1)
       : operand0_(lhs), operand1_(rhs1), operand2_(), is_label(false) {
-    repr = operand0_.toString() + " <- " + operand1_.toString();
   }  // var <- var
 
   // so we can have a label in the instruction stream
   Instruction(Operand lhs)
       : operand0_(lhs), operand1_(), operand2_(), is_label(true) {
     assert(operand0_.GetOperandType() == OperandType::Label);
-    repr = operand0_.toString();
   }
 
-  std::string const toString() const { return repr; }
-  const Operand getJumpTarget() {
+  // Formats the instruction from its fields, nothing is cached
+  void print(std::ostream& os) const;
+  // Just the right hand side of an assignment, e.g. "a ADD b"
+  void printExpr(std::ostream& os) const;
+  std::string const toString() const;
+  const Operand getJumpTarget() const {
     assert(op == Opcode::jump_conditional || op == Opcode::jump_unconditional);
     if (op == Opcode::jump_conditional) {
       return operand1_;
@@ -128,6 +251,16 @@ class Instruction {
       return operand0_;
     }
   }
+  void setJumpTarget(Operand label) {
+    assert(op == Opcode::jump_conditional || op == Opcode::jump_unconditional);
+    (op == Opcode::jump_conditional ? operand1_ : operand0_) = label;
+  }
+  // Whether control never falls through to the next instruction: jumps,
+  // return and output (which ends the program)
+  bool endsFallthrough() const {
+    return !is_label && (op == Opcode::jump_unconditional ||
+                         op == Opcode::ret || op == Opcode::output);
+  }
   std::optional<Operand> const getLabel() const {
     if (operand0_.GetOperandType() == OperandType::Label &&
         getOpcode() != Opcode::jump_unconditional) {
@@ -139,6 +272,11 @@ class Instruction {
 
   Opcode const getOpcode() const { return op; }
   Operand const getOperand0() const { return operand0_; }
+  // Renames the variable a definition assigns to
+  void setOperand0(Operand lhs) {
+    assert(isDefinition());
+    operand0_ = lhs;
+  }
 
   bool isUnary() const {
     auto op = getOpcode();
@@ -159,17 +297,26 @@ class Instruction {
     }
   }
 
+  // Whether the instruction assigns to operand0: binops, unary ops and
+  // copies, but not jump_if_0 whose operand0 is the guard it reads
+  bool isDefinition() const {
+    return !is_label && (isUnary() || isBinary() ||
+                         (op == Opcode::NIL &&
+                          operand1_.GetOperandType() != OperandType::None));
+  }
+
   bool isBinary() const {
     if (op == Opcode::ADD || op == Opcode::SUB || op == Opcode::MUL ||
         op == Opcode::LT || op == Opcode::LE || op == Opcode::EQ ||
-        op == Opcode::AND) {
+        op == Opcode::AND || op == Opcode::OR) {
       return true;
     }
     return false;
   }
 
+  // The first source: the operand of a unary op or the value of a copy
   Operand const getOperand1() const {
-    assert(isUnary() || isBinary());
+    assert(isDefinition());
     return operand1_;
   }
 
@@ -178,17 +325,123 @@ class Instruction {
     return operand2_;
   }
 
-  bool isLabel() { return is_label; }
+  bool isLabel() const { return is_label; }
+
+  // Calls f on each operand the instruction reads (never labels or the
+  // callee of a CALL). f gets a reference and may rewrite the operand.
+  template <typename F>
+  void forEachUse(F f) {
+    forEachUseOf(*this, f);
+  }
+  template <typename F>
+  void forEachUse(F f) const {
+    forEachUseOf(*this, f);
+  }
 
  private:
+  template <typename Self, typename F>
+  static void forEachUseOf(Self& instr, F& f) {
+    if (instr.is_label || instr.op == Opcode::jump_unconditional ||
+        instr.op == Opcode::CALL) {
+      return;
+    }
+    if (instr.op == Opcode::arg || instr.op == Opcode::ret ||
+        instr.op == Opcode::output || instr.op == Opcode::jump_conditional) {
+      f(instr.operand0_);
+      return;
+    }
+    f(instr.operand1_);
+    if (instr.operand2_.GetOperandType() != OperandType::None) {
+      f(instr.operand2_);
+    }
+  }
+
   Operand operand0_;
   Opcode op = Opcode::NIL;
   Operand operand1_;
   Operand operand2_;
-  std::string repr;
   bool is_label;
 };
 
+inline std::ostream& operator<<(std::ostream& os, const Instruction& instr) {
+  instr.print(os);
+  return os;
+}
+
+// Structural identity of the right hand side of a binary instruction. The
+// operands of commutative opcodes are kept in a canonical order, so a ADD b
+// and b ADD a are the same expression.
+struct ExprKey {
+  Opcode op;
+  Operand lhs;
+  Operand rhs;
+
+  ExprKey(Opcode op, Operand lhs, Operand rhs);
+  static ExprKey of(const Instruction& instr) {
+    return ExprKey(instr.getOpcode(), instr.getOperand1(),
+                   instr.getOperand2());
+  }
+  static bool isCommutative(Opcode op) {
+    return op == Opcode::ADD || op == Opcode::MUL || op == Opcode::EQ ||
+           op == Opcode::AND || op == Opcode::OR;
+  }
+
+  bool uses(const Operand& var) const { return lhs == var || rhs == var; }
+  bool operator==(const ExprKey& rhs_) const {
+    return op == rhs_.op && lhs == rhs_.lhs && rhs == rhs_.rhs;
+  }
+};
+
+struct ExprKeyHash {
+  uint64_t operator()(const ExprKey& key) const {
+    return mixBits(key.lhs.bits() ^
+                   mixBits(key.rhs.bits() + static_cast<uint64_t>(key.op)));
+  }
+};
+
+using ExprTable = IndexTable<ExprKey, ExprKeyHash>;
+
+// An operation on value numbers, the value-numbering analogue of ExprKey.
+// Operands of commutative operators are put in increasing order.
+struct ValueExpr {
+  Opcode op;
+  int lhs;
+  int rhs;
+
+  ValueExpr(Opcode op, int lhs, int rhs) : op(op), lhs(lhs), rhs(rhs) {
+    if (ExprKey::isCommutative(op) && rhs < lhs) {
+      std::swap(this->lhs, this->rhs);
+    }
+  }
+
+  bool operator==(const ValueExpr& other) const {
+    return op == other.op && lhs == other.lhs && rhs == other.rhs;
+  }
+};
+
+struct ValueExprHash {
+  uint64_t operator()(const ValueExpr& expr) const {
+    return mixBits((static_cast<uint64_t>(expr.lhs) << 32) ^
+                   static_cast<uint32_t>(expr.rhs) ^
+                   (static_cast<uint64_t>(expr.op) << 56));
+  }
+};
+
+// lhs <- phi(args...) at the top of a block in SSA form. args[i] is the
+// value flowing in from the block's i-th predecessor, in the order of
+// CFG::predecessors.
+struct Phi {
+  Operand lhs;
+  std::vector<Operand> args;
+
+  void print(std::ostream& os) const;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Phi& phi) {
+  phi.print(os);
+  return os;
+}
+
 class BasicBlock {
  public:
   bool operator==(const BasicBlock& rhs) {
@@ -200,67 +453,230 @@ class BasicBlock {
   }
   // bool operator!=(const BasicBlock& rhs) const { return !operator==(rhs); }
 
-  BasicBlock(std::vector<Instruction> instr, std::set<int> succ, int idx)
-      : blockID(idx), instructions_(instr), successors_(succ) {}
-  BasicBlock(std::vector<Instruction> instr, std::set<int> succ,
-             std::set<int> pred, int idx)
-      : blockID(idx),
-        instructions_(instr),
-        successors_(succ),
-        predecessors_(pred) {}
+  // Edges are not stored in the block, the CFG derives them from the labels
+  // and the jump (or fall through) at the end of each block
+  BasicBlock(std::vector<Instruction> instr, int idx)
+      : blockID(idx), instructions_(std::move(instr)) {}
 
   void setinstruction(int index, Instruction a);
   const std::vector<Instruction>& instructions() const { return instructions_; }
+  void setInstructions(std::vector<Instruction> instr) {
+    instructions_ = std::move(instr);
+  }
   void addstatement(int index, Instruction input);
-  const std::set<int>& getSuccessors() { return successors_; }
-  const std::set<int>& getPredecessors() { return predecessors_; }
-  void insertPredecessor(int pred) { predecessors_.insert(pred); }
-  int getBlockID() { return blockID; }
+  int getBlockID() const { return blockID; }
+
+  // Phis run in parallel before the first instruction; only SSA form CFGs
+  // have any
+  const std::vector<Phi>& phis() const { return phis_; }
+  void setPhis(std::vector<Phi> phis) { phis_ = std::move(phis); }
 
  private:
   int blockID;
   std::vector<Instruction> instructions_;
-  std::set<int> successors_;
-  std::set<int> predecessors_;
+  std::vector<Phi> phis_;
 };
 
-class CFG {
+// A block's successors or predecessors: a view into one of the CFG's flat
+// edge arrays
+class EdgeRange {
  public:
-  CFG(std::vector<BasicBlock> b) : basic_blocks(b) {}
+  EdgeRange(const int* first, const int* last) : first_(first), last_(last) {}
+  const int* begin() const { return first_; }
+  const int* end() const { return last_; }
+  std::size_t size() const { return last_ - first_; }
+  bool empty() const { return first_ == last_; }
+  int operator[](std::size_t i) const { return first_[i]; }
 
-  void getAllExpressions();
-  void resetAvailExprs(const std::vector<std::pair<std::vector<bool>, std::vector<bool>>>&);
-  std::pair<std::vector<bool>, std::vector<bool>> computeGenKill(
-      BasicBlock block);
-  std::vector<std::pair<std::vector<bool>, std::vector<bool>>> getAllGenKill();
+ private:
+  const int* first_;
+  const int* last_;
+};
 
+// gen/kill sets of a block, or its in/out sets
+using BitVectorPair = std::pair<BitVector, BitVector>;
+
+// A natural loop: the header plus every block that reaches one of the
+// back edges into it without passing through the header
+struct NaturalLoop {
+  int header;
+  std::vector<int> blocks;   // sorted, includes the header
+  std::vector<int> latches;  // sources of the back edges
+  int parent = -1;           // index of the innermost enclosing loop
+  int depth = 1;             // 1 for outermost loops
+};
 
+class CFG {
+ public:
+  explicit CFG(std::vector<BasicBlock> b) : basic_blocks(std::move(b)) {
+    buildEdges();
+  }
+  // a CFG owns all the instructions of a function, it is never copied
+  CFG(const CFG&) = delete;
+  CFG& operator=(const CFG&) = delete;
+
+  const std::vector<BasicBlock>& getBlocks() const { return basic_blocks; }
+  std::size_t size() const { return basic_blocks.size(); }
+
+  // For rewrites that keep every block's label and the targets of its
+  // final jump, so edges and cached analyses stay valid
+  BasicBlock& getBlock(int block) { return basic_blocks[block]; }
+  // Replaces the whole function body. Edges are rebuilt and the cached
+  // orderings, dominators and loops are dropped
+  void setBlocks(std::vector<BasicBlock> blocks);
+
+  // Edges in compressed sparse row form: the successors of block b are
+  // succEdges[succOffsets[b] .. succOffsets[b + 1]), both lists are sorted
+  EdgeRange successors(int block) const {
+    return EdgeRange(succEdges.data() + succOffsets[block],
+                     succEdges.data() + succOffsets[block + 1]);
+  }
+  EdgeRange predecessors(int block) const {
+    return EdgeRange(predEdges.data() + predOffsets[block],
+                     predEdges.data() + predOffsets[block + 1]);
+  }
 
-  bool checkifkilled(int blocknumber, int index, Instruction available);
-  void runWorklist(
-      const std::vector<std::pair<std::vector<bool>, std::vector<bool>>>&);
+  // Instructions in the function, not counting labels
+  std::size_t instructionCount() const {
+    std::size_t n = 0;
+    for (const auto& block : basic_blocks) {
+      for (const auto& instr : block.instructions()) {
+        n += !instr.isLabel();
+      }
+    }
+    return n;
+  }
 
-  void computeAvailExprs();
-  std::vector<BasicBlock> computeGCSE(
-      const std::vector<std::pair<std::vector<bool>, std::vector<bool>>>&);
+  // Puts an empty block on every edge from a block with several successors
+  // to a block with several predecessors, keeping phi arguments with their
+  // edges. Returns whether any edge was split.
+  bool splitCriticalEdges();
+  // Puts an empty block in front of the entry block if it has predecessors
+  // (when the function starts with a loop), so values on entry never meet
+  // a back edge. Returns whether a block was added.
+  bool isolateEntry();
+  // Gives every natural loop a preheader: a block outside the loop whose
+  // only successor is the header and which is the header's only
+  // predecessor outside the loop. Where none exists, a block labelled
+  // PREHEADER_n is put right before the header and the jumps into the
+  // header from outside are retargeted to it. Loops whose header is
+  // entered by falling through from inside the loop are left alone.
+  // Returns whether a block was added.
+  bool insertPreheaders();
+  // The preheader of loops()[loop], -1 if it has none
+  int preheader(int loop) const;
 
-  void optimize(int blocknumber, int index, int available);
+  void getAllExpressions();
+  BitVectorPair computeGenKill(const BasicBlock& block);
+  std::vector<BitVectorPair> getAllGenKill();
+
+  // Solves available expressions to a fixed point with the generic
+  // DataflowAnalysis engine (forward, intersection, gen/kill transfer)
+  void runWorklist(const std::vector<BitVectorPair>&);
+  // Number of transfer function evaluations done by the last runWorklist
+  int getWorklistIterations() const { return worklistIterations; }
+
+  // Structural analyses. They are computed on first use and cached until
+  // the blocks are replaced.
+
+  // Blocks reachable from the entry block, in reverse postorder
+  const std::vector<int>& reversePostorder() const;
+  // Position of block in reversePostorder(), -1 if unreachable
+  int rpoNumber(int block) const;
+
+  // Immediate dominator, -1 for the entry block and unreachable blocks
+  int idom(int block) const;
+  EdgeRange domChildren(int block) const;
+  bool dominates(int a, int b) const;
+  EdgeRange dominanceFrontier(int block) const;
+
+  // Natural loops, outer loops before the loops nested in them
+  const std::vector<NaturalLoop>& loops() const;
+  // Innermost loop containing block (index into loops()), -1 if none
+  int innermostLoop(int block) const;
+  int loopDepth(int block) const;
 
-  
+  void computeAvailExprs();
+  // Rewrites the blocks in place with the available expressions last
+  // computed. Returns whether a computation was replaced by a copy.
+  bool computeGCSE();
 
-  std::vector<std::pair<std::vector<bool>, std::vector<bool>>>
-  getAvailableExpressions() {
+  const std::vector<BitVectorPair>& getAvailableExpressions() const {
     return availableExpressions;
   }
 
+  // Counters for a VersionScope over this function
+  VersionCounters& versionCounters() { return versions; }
+
  private:
-  std::map<std::string, int> legend;  // e.g. "a+b" -> 3
-  std::vector<bool> allExprs;
-  std::vector<std::pair<std::vector<bool>, std::vector<bool>>>
+  ExprTable legend;  // e.g. a ADD b -> 3
+  // N of the _optN holding each expression of legend
+  std::vector<int> optIds;
+  // variables used by some expression, and for each the expressions
+  // (indices into legend) using it
+  IndexTable<Operand, OperandHash> exprVars;
+  std::vector<std::vector<int>> exprsUsingVar;
+  // scratch for computeGenKill: definedStamp[v] == stamp marks v as defined
+  // further down the current block, so nothing has to be cleared per block
+  std::vector<uint32_t> definedStamp;
+  uint32_t stamp = 0;
+  BitVector allExprs;
+  std::vector<BitVectorPair>
       availableExpressions;  // each pair holds the in set and the out set for
                              // a block
-  std::vector<BasicBlock> optimized_program;  // final answer
-  std::vector<BasicBlock> basic_blocks;       //
+  int worklistIterations = 0;
+  std::vector<BasicBlock> basic_blocks;
+
+  void buildEdges();
+  std::vector<int> succOffsets, succEdges;
+  std::vector<int> predOffsets, predEdges;
+
+  void invalidateAnalyses();
+  void computeOrder() const;
+  void computeDominators() const;
+  void computeLoops() const;
+
+  struct OrderCache {
+    bool valid = false;
+    std::vector<int> rpo;
+    std::vector<int> number;
+  };
+  struct DominatorCache {
+    bool valid = false;
+    std::vector<int> idom;
+    // dominator tree children and dominance frontiers, both CSR like the
+    // edges
+    std::vector<int> childOffsets, children;
+    std::vector<int> frontierOffsets, frontiers;
+    // preorder entry/exit numbers in the dominator tree, for O(1)
+    // dominates()
+    std::vector<int> enter, exit;
+  };
+  struct LoopCache {
+    bool valid = false;
+    std::vector<NaturalLoop> loops;
+    std::vector<int> innermost;
+  };
+  mutable OrderCache order;
+  mutable DominatorCache dom;
+  mutable LoopCache loopInfo;
+  VersionCounters versions;
+};
+
+// A whole program: the CFG of each function, with the top-level statements
+// as the function "global", and the parameters of each function
+struct Module {
+  std::map<std::string, std::unique_ptr<CFG>> functions;
+  std::map<std::string, std::vector<Operand>> params;
+
+  // Instructions in all functions, not counting labels
+  std::size_t instructionCount() const {
+    std::size_t n = 0;
+    for (const auto& [name, cfg] : functions) {
+      n += cfg->instructionCount();
+    }
+    return n;
+  }
 };
 
 // similar to codegen context
@@ -281,6 +697,12 @@ struct IRSymbolTable {
 // relevant pieces of code as it traverses a node
 class IR final : public AstVisitor {
  public:
+  // With shortCircuitGuards, the guards of conditionals and loops become
+  // chains of jumps: && and || skip their right operand once the left one
+  // decides, and no boolean is computed for them or for !
+  explicit IR(bool shortCircuitGuards = false)
+      : shortCircuit(shortCircuitGuards) {}
+
   // Entry point of the code generator. This function should visit given
   // program and return generated code as a list of three address code
   // instructions
@@ -314,12 +736,21 @@ class IR final : public AstVisitor {
 
   void VisitProgramExpr(const Program& program) override;
 
-  std::vector<int> getLeaders(std::vector<Instruction>);
-  std::vector<BasicBlock> getBB(std::vector<Instruction>);
+  std::vector<int> getLeaders(const std::vector<Instruction>&);
+  std::vector<BasicBlock> getBB(const std::vector<Instruction>&);
 
-  std::map<std::string, std::vector<BasicBlock>> ProgramBlocks() {
+  // The blocks of each function; callers can move them into a CFG
+  std::map<std::string, std::vector<BasicBlock>>& ProgramBlocks() {
     return program_blocks;
   }
+  // The parameters of each function, in order. The TAC only binds them
+  // implicitly, to the arg instructions before a call.
+  const std::map<std::string, std::vector<Operand>>& ProgramParameters()
+      const {
+    return program_params;
+  }
+  // Moves the blocks of every function into a Module
+  Module buildModule();
 
  private:
   std::vector<Operand> arg_stack;
@@ -328,23 +759,37 @@ class IR final : public AstVisitor {
   uint32_t nextIndex = 0;
   uint32_t freshIndex() { return nextIndex++; }
 
+  // Where a guard lowered to jumps goes: to label when its value is onTrue
+  // (nonzero or 0), falling through otherwise
+  struct BranchTarget {
+    Operand label;
+    bool onTrue;
+  };
+  bool shortCircuit;
+  // Set for the guard about to be visited; its visitor takes it
+  std::optional<BranchTarget> branch;
+  void emitBranch(const RelationalExpr& guard, Operand label, bool onTrue);
+  std::optional<BranchTarget> takeBranch();
+  void branchOn(Operand cond, const BranchTarget& target);
+
   // List of instructions generated
   std::vector<Instruction> insns;
 
   // for each function def
   std::map<std::string, std::vector<BasicBlock>> program_blocks;
+  std::map<std::string, std::vector<Operand>> program_params;
 
   // Symbol table
   IRSymbolTable symbolTable;
 
   // reused from codegen
   class TmpVar {
-    std::string name;
+    Operand var;
     IR& ir;
 
    public:
-    std::string getName() { return name; };
-    explicit TmpVar(const std::string& name, IR& ir);
+    Operand getOperand() const { return var; };
+    explicit TmpVar(Operand var, IR& ir);
     TmpVar(const TmpVar&) = delete;
     ~TmpVar();
     int32_t operator*() const;
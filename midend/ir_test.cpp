@@ -0,0 +1,1800 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <sstream>
+#include <unordered_map>
+
+#include "midend/ir.h"
+#include "midend/callgraph.h"
+#include "midend/dataflow.h"
+#include "midend/liveness.h"
+#include "midend/pass_manager.h"
+#include "midend/passes.h"
+#include "catch2/catch.hpp"
+#include "frontend/lexer.h"
+#include "frontend/parser.h"
+
+using namespace cs160::frontend;
+using namespace cs160::midend;
+
+namespace {
+
+std::map<std::string, std::vector<BasicBlock>> blocksFor(
+    const std::string& source) {
+  auto ast = Parser(Lexer().tokenize(source)).parse();
+  IR ir;
+  ir.generateCFG(*ast);
+  return ir.ProgramBlocks();
+}
+
+Module compile(const std::string& source, bool shortCircuit = false) {
+  auto ast = Parser(Lexer().tokenize(source)).parse();
+  IR ir(shortCircuit);
+  ir.generateCFG(*ast);
+  return ir.buildModule();
+}
+
+std::string readFile(const std::filesystem::path& path) {
+  std::ifstream in(path);
+  std::stringstream text;
+  text << in.rdbuf();
+  return text.str();
+}
+
+// Executes TAC directly so passes can be checked against the unoptimized
+// program. Unset variables read as 0 and calls to undefined functions
+// return 0, which lets every program in tests/ run to completion. Phis are
+// evaluated in parallel on entry to their block.
+class Interpreter {
+ public:
+  explicit Interpreter(const Module& program) : program(program) {}
+
+  // The value output by the program, or nothing if it ran out of steps
+  std::optional<int> run() {
+    try {
+      call("global", {});
+    } catch (const Output& out) {
+      return out.value;
+    } catch (const OutOfSteps&) {
+    }
+    return std::nullopt;
+  }
+
+  // Instructions executed so far, labels excluded
+  long executed = 0;
+  // Binary operations evaluated so far
+  long computed = 0;
+
+ private:
+  struct Output {
+    int value;
+  };
+  struct OutOfSteps {};
+  static constexpr long stepLimit = 10000000;
+
+  int call(const std::string& name, const std::vector<int>& args) {
+    auto fn = program.functions.find(name);
+    if (fn == program.functions.end()) {
+      return 0;
+    }
+    const auto& blocks = fn->second->getBlocks();
+    std::unordered_map<Operand, int, OperandHash> env;
+    auto params = program.params.find(name);
+    if (params != program.params.end()) {
+      for (std::size_t i = 0; i < params->second.size() && i < args.size();
+           ++i) {
+        env[params->second[i]] = args[i];
+      }
+    }
+    std::unordered_map<Operand, std::size_t, OperandHash> labels;
+    for (std::size_t b = 0; b < blocks.size(); ++b) {
+      const auto& instrs = blocks[b].instructions();
+      if (!instrs.empty() && instrs.front().getLabel()) {
+        labels[*instrs.front().getLabel()] = b;
+      }
+    }
+    auto value = [&](const Operand& operand) {
+      if (operand.GetOperandType() == OperandType::Int) {
+        return operand.GetConstant();
+      }
+      auto it = env.find(operand);
+      return it == env.end() ? 0 : it->second;
+    };
+
+    std::vector<int> pending;
+    std::size_t b = 0;
+    int prev = -1;
+    while (b < blocks.size()) {
+      std::size_t next = b + 1;
+      if (!blocks[b].phis().empty()) {
+        auto preds = fn->second->predecessors(b);
+        auto i = std::find(preds.begin(), preds.end(), prev) - preds.begin();
+        std::vector<int> values;
+        for (const auto& phi : blocks[b].phis()) {
+          values.push_back(value(phi.args.at(i)));
+        }
+        for (std::size_t p = 0; p < values.size(); ++p) {
+          env[blocks[b].phis()[p].lhs] = values[p];
+        }
+      }
+      for (const auto& instr : blocks[b].instructions()) {
+        if (instr.isLabel()) {
+          continue;
+        }
+        if (++executed > stepLimit) {
+          throw OutOfSteps{};
+        }
+        auto op = instr.getOpcode();
+        if (op == Opcode::arg) {
+          pending.push_back(value(instr.getOperand0()));
+        } else if (op == Opcode::ret) {
+          return value(instr.getOperand0());
+        } else if (op == Opcode::output) {
+          throw Output{value(instr.getOperand0())};
+        } else if (op == Opcode::jump_unconditional) {
+          next = labels.at(instr.getJumpTarget());
+        } else if (op == Opcode::jump_conditional) {
+          if (value(instr.getOperand0()) == 0) {
+            next = labels.at(instr.getJumpTarget());
+          }
+        } else if (op == Opcode::CALL) {
+          auto callArgs = std::move(pending);
+          pending.clear();
+          env[instr.getOperand0()] =
+              call(instr.getOperand1().GetVariableName(), callArgs);
+        } else if (op == Opcode::NIL) {
+          env[instr.getOperand0()] = value(instr.getOperand1());
+        } else {
+          computed += instr.isBinary();
+          int rhs = instr.isBinary() ? value(instr.getOperand2()) : 0;
+          env[instr.getOperand0()] =
+              EvaluateOpcode(op, value(instr.getOperand1()), rhs);
+        }
+      }
+      prev = b;
+      b = next;
+    }
+    return 0;
+  }
+
+  const Module& program;
+};
+
+// Whether every variable is assigned by exactly one instruction or phi
+bool isSingleAssignment(const CFG& cfg) {
+  std::unordered_map<Operand, int, OperandHash> defs;
+  for (const auto& block : cfg.getBlocks()) {
+    for (const auto& phi : block.phis()) {
+      ++defs[phi.lhs];
+    }
+    for (const auto& instr : block.instructions()) {
+      if (instr.isDefinition()) {
+        ++defs[instr.getOperand0()];
+      }
+    }
+  }
+  return std::all_of(defs.begin(), defs.end(),
+                     [](const auto& def) { return def.second == 1; });
+}
+
+int countPhis(const CFG& cfg) {
+  int n = 0;
+  for (const auto& block : cfg.getBlocks()) {
+    n += block.phis().size();
+  }
+  return n;
+}
+
+int countOpcode(const CFG& cfg, Opcode op) {
+  int n = 0;
+  for (const auto& block : cfg.getBlocks()) {
+    for (const auto& instr : block.instructions()) {
+      n += !instr.isLabel() && instr.getOpcode() == op;
+    }
+  }
+  return n;
+}
+
+// The programs in tests/
+std::vector<std::filesystem::path> testPrograms() {
+  std::vector<std::filesystem::path> paths;
+  for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+    if (entry.path().extension() == ".l1") {
+      paths.push_back(entry.path());
+    }
+  }
+  return paths;
+}
+
+// Compiles every program in tests/ twice, applies transform to the second
+// copy and checks both output the same. compare is then given the two runs,
+// to check what the transformation saved. With shortCircuit the transformed
+// copy is compiled with short-circuit guards.
+void checkTestsPreserveOutput(
+    const std::function<void(Module&)>& transform,
+    const std::function<void(const Interpreter&, const Interpreter&)>&
+        compare = nullptr,
+    bool shortCircuit = false) {
+  for (const auto& path : testPrograms()) {
+    INFO(path);
+    auto source = readFile(path);
+    auto original = compile(source);
+    auto program = compile(source, shortCircuit);
+    transform(program);
+    Interpreter reference(original);
+    Interpreter optimized(program);
+    CHECK(optimized.run() == reference.run());
+    if (compare) {
+      compare(reference, optimized);
+    }
+  }
+}
+
+}  // namespace
+
+TEST_CASE("Operand encoding", "[ir]") {
+  SECTION("constants") {
+    Operand c(-284);
+    REQUIRE(c.GetOperandType() == OperandType::Int);
+    REQUIRE(c.GetConstant() == -284);
+    REQUIRE(c.toString() == "-284");
+  }
+
+  SECTION("interned symbols") {
+    Operand x("x", OperandType::Var);
+    REQUIRE(x == Operand("x", OperandType::Var));
+    REQUIRE(x != Operand("y", OperandType::Var));
+    REQUIRE(x != Operand("x", OperandType::Function));
+    REQUIRE(x.GetVariableName() == "x");
+  }
+
+  SECTION("generated names") {
+    Operand tmp(NameKind::Tmp, 1234, OperandType::Var);
+    REQUIRE(tmp.toString() == "_tmp1234");
+    REQUIRE(tmp != Operand(1234));
+    Operand label(NameKind::WhileEnd, 7, OperandType::Label);
+    REQUIRE(label.toString() == "WHILE_END_7:");
+  }
+
+  SECTION("instructions stay small") {
+    REQUIRE(sizeof(Operand) == 8);
+    REQUIRE(Operand().GetOperandType() == OperandType::None);
+    REQUIRE(Operand().toString() == "");
+  }
+}
+
+TEST_CASE("Instruction text", "[ir]") {
+  auto tmp = Operand(NameKind::Tmp, 0, OperandType::Var);
+  auto x = Operand("x", OperandType::Var);
+  CHECK(Instruction(tmp, Opcode::ADD, x, Operand(1)).toString() ==
+        "_tmp0 <- x ADD 1");
+  CHECK(Instruction(x, tmp).toString() == "x <- _tmp0");
+  CHECK(Instruction(Opcode::output, x).toString() == "output x");
+  CHECK(Instruction(tmp, Opcode::NOT, x).toString() == "_tmp0 <- ! x");
+
+  auto label = Operand(NameKind::IfFalse, 2, OperandType::Label);
+  CHECK(Instruction(label).toString() == "IF_FALSE_2:");
+  CHECK(Instruction(tmp, Opcode::jump_conditional, label).toString() ==
+        "jump_if_0 _tmp0 IF_FALSE_2:");
+  CHECK(Instruction(Opcode::jump_unconditional, label).toString() ==
+        "jump IF_FALSE_2:");
+
+  std::ostringstream os;
+  Instruction(tmp, Opcode::LT, Operand(0), x).printExpr(os);
+  CHECK(os.str() == "0 LT x");
+}
+
+TEST_CASE("Expression keys", "[ir]") {
+  auto a = Operand("a", OperandType::Var);
+  auto b = Operand("b", OperandType::Var);
+  auto tmp = Operand(NameKind::Tmp, 0, OperandType::Var);
+
+  SECTION("commutative operands are canonicalized") {
+    CHECK(ExprKey(Opcode::ADD, a, b) == ExprKey(Opcode::ADD, b, a));
+    CHECK(ExprKey(Opcode::OR, a, b) == ExprKey(Opcode::OR, b, a));
+    CHECK(!(ExprKey(Opcode::SUB, a, b) == ExprKey(Opcode::SUB, b, a)));
+    CHECK(!(ExprKey(Opcode::LT, a, b) == ExprKey(Opcode::LE, a, b)));
+    CHECK(ExprKey::of(Instruction(tmp, Opcode::MUL, b, Operand(2)))
+              .uses(b));
+  }
+
+  SECTION("numbering is dense and in insertion order") {
+    ExprTable table;
+    CHECK(table.find(ExprKey(Opcode::ADD, a, b)) == -1);
+    for (int i = 0; i < 1000; ++i) {
+      REQUIRE(table.insert(ExprKey(Opcode::SUB, a, Operand(i))) == i);
+    }
+    CHECK(table.insert(ExprKey(Opcode::SUB, a, Operand(500))) == 500);
+    CHECK(table.find(ExprKey(Opcode::SUB, a, Operand(999))) == 999);
+    CHECK(table.find(ExprKey(Opcode::SUB, b, Operand(1))) == -1);
+    CHECK(table.size() == 1000);
+  }
+}
+
+TEST_CASE("Bit vectors", "[ir]") {
+  SECTION("word boundaries") {
+    BitVector all(130, true);
+    CHECK(all.count() == 130);
+    all.reset(64);
+    CHECK(!all.test(64));
+    CHECK(all.test(129));
+    all.resetAll();
+    CHECK(!all.any());
+    all.setAll();
+    CHECK(all == BitVector(130, true));
+  }
+
+  SECTION("in place operations report changes") {
+    BitVector a(100), b(100);
+    a.set(3);
+    a.set(70);
+    b.set(70);
+    CHECK(!b.unionWith(BitVector(100)));
+    CHECK(a.intersectWith(b));
+    CHECK(!a.intersectWith(b));
+    CHECK(a == b);
+    CHECK(a.subtract(b));
+    CHECK(!a.any());
+  }
+
+  SECTION("gen/kill transfer") {
+    BitVector gen(70), in(70), kill(70), out(70);
+    gen.set(1);
+    in.set(2);
+    in.set(69);
+    kill.set(69);
+    CHECK(out.assignTransfer(gen, in, kill));
+    CHECK(!out.assignTransfer(gen, in, kill));
+    std::vector<std::size_t> bits;
+    out.forEachSetBit([&](std::size_t i) { bits.push_back(i); });
+    CHECK(bits == std::vector<std::size_t>{1, 2});
+  }
+}
+
+TEST_CASE("Available expressions reach a fixed point", "[ir]") {
+  // a*b is computed before the loop but a changes at the end of the body,
+  // so it must not be available at the loop head even though the first
+  // visit of the head only sees it on the entry edge
+  auto blocks = blocksFor(
+      "x := a * b; while (x < 10) { x := a * b; a := a + 1; } output x;");
+  CFG cfg(blocks["global"]);
+  cfg.computeAvailExprs();
+  const auto& avail = cfg.getAvailableExpressions();
+
+  REQUIRE(avail.size() == 4);
+  CHECK(avail[0].second.test(0));   // a MUL b available leaving the entry
+  CHECK(!avail[1].first.test(0));   // but not at the loop head
+  CHECK(!avail[2].second.test(0));  // killed at the end of the body
+  CHECK(!avail[3].first.test(0));
+  CHECK(cfg.getWorklistIterations() > 4);  // the loop head is revisited
+
+  auto rpo = cfg.reversePostorder();
+  REQUIRE(rpo.size() == 4);
+  CHECK(rpo.front() == 0);
+}
+
+TEST_CASE("GCSE reuses the saved value of an available expression", "[ir]") {
+  // blocks: 0 entry, 1 then, 2 else, 3 end
+  auto blocks = blocksFor(
+      "x := a + b; if (x < 5) { y := a + b; } else { a := 1; y := a + b; } "
+      "output y;");
+  CFG cfg(std::move(blocks["global"]));
+  cfg.computeAvailExprs();
+  cfg.computeGCSE();
+  auto reads = [&](int block, const std::string& expr) {
+    for (const auto& instr : cfg.getBlocks()[block].instructions()) {
+      auto text = instr.toString();
+      if (text.size() >= expr.size() &&
+          text.compare(text.size() - expr.size(), expr.size(), expr) == 0) {
+        return true;
+      }
+    }
+    return false;
+  };
+  CHECK(reads(0, "<- a ADD b"));
+  CHECK(reads(1, "<- _opt0"));
+  CHECK(!reads(1, "<- a ADD b"));
+  // a is redefined earlier in the block, so a + b is computed again
+  CHECK(reads(2, "<- a ADD b"));
+  CHECK(!reads(2, "<- _opt0"));
+}
+
+TEST_CASE("GCSE numbers _optN in lexicographic order of the expressions",
+          "[ir]") {
+  auto blocks = blocksFor(
+      "x := b * c; y := a + b; if ([x < y] || [y < 3]) { z := 1; } else { "
+      "z := 2; } output z;");
+  CFG cfg(std::move(blocks["global"]));
+  cfg.computeAvailExprs();
+  // bits stay in order of first occurrence, and OR is not an expression
+  REQUIRE(cfg.getAvailableExpressions()[0].second.size() == 4);
+  cfg.computeGCSE();
+
+  std::map<std::string, std::string> saved;
+  const auto& instrs = cfg.getBlocks()[0].instructions();
+  for (std::size_t i = 0; i + 1 < instrs.size(); ++i) {
+    auto copy = instrs[i + 1].toString();
+    if (copy.rfind("_opt", 0) != 0) {
+      continue;
+    }
+    std::ostringstream expr;
+    instrs[i].printExpr(expr);
+    saved[expr.str()] = copy.substr(0, copy.find(' '));
+  }
+  CHECK(saved == std::map<std::string, std::string>{{"a ADD b", "_opt0"},
+                                                    {"b MUL c", "_opt1"},
+                                                    {"x LT y", "_opt2"},
+                                                    {"y LT 3", "_opt3"}});
+}
+
+TEST_CASE("Generic dataflow engine", "[ir]") {
+  // blocks: 0 entry, 1 loop head, 2 body, 3 exit
+  auto blocks = blocksFor("x := 0; while (x < 10) { x := x + 1; } output x;");
+  CFG cfg(blocks["global"]);
+  REQUIRE(cfg.getBlocks().size() == 4);
+
+  // gen = {the block itself}, kill = {}: forward this collects the blocks
+  // on some path from the entry, backward the blocks reachable from a block
+  auto paths = [&](auto domain) {
+    using Domain = decltype(domain);
+    std::vector<std::pair<Domain, Domain>> genkill;
+    for (int b = 0; b < 4; ++b) {
+      genkill.emplace_back(Domain(4), Domain(4));
+      genkill.back().first.set(b);
+    }
+    DataflowAnalysis<Domain, Forward, UnionMeet, GenKillTransfer<Domain>> fwd(
+        cfg, Domain(4), Domain(4), {genkill});
+    DataflowAnalysis<Domain, Backward, UnionMeet, GenKillTransfer<Domain>>
+        bwd(cfg, Domain(4), Domain(4), {genkill});
+    fwd.run();
+    bwd.run();
+    std::vector<std::pair<std::vector<int>, std::vector<int>>> sets;
+    for (int b = 0; b < 4; ++b) {
+      std::vector<int> before, after;
+      fwd.out(b).forEachSetBit([&](std::size_t i) { before.push_back(i); });
+      bwd.in(b).forEachSetBit([&](std::size_t i) { after.push_back(i); });
+      sets.emplace_back(before, after);
+    }
+    return sets;
+  };
+
+  auto reached = paths(BitVector());
+  CHECK(reached[0].first == std::vector<int>{0});
+  CHECK(reached[2].first == std::vector<int>{0, 1, 2});
+  CHECK(reached[3].first == std::vector<int>{0, 1, 2, 3});
+  CHECK(reached[0].second == std::vector<int>{0, 1, 2, 3});
+  CHECK(reached[3].second == std::vector<int>{3});
+}
+
+TEST_CASE("Gen and kill sets", "[ir]") {
+  auto blocks = blocksFor("x := a + b; a := 1; y := c * d; output y;");
+  CFG cfg(blocks["global"]);
+  cfg.getAllExpressions();
+  auto genkill = cfg.getAllGenKill();
+  REQUIRE(genkill.size() == 1);
+
+  auto& [gen, kill] = genkill[0];
+  REQUIRE(gen.size() == 2);
+  CHECK(!gen.test(0));  // a ADD b, a is redefined afterwards
+  CHECK(gen.test(1));   // c MUL d
+  CHECK(kill.test(0));
+  CHECK(!kill.test(1));
+}
+
+TEST_CASE("CFG edges", "[ir]") {
+  auto blocks = blocksFor(
+      "x := 0; while (x < 10) { if (x < 5) { x := x + 2; } else { x := x + 1; "
+      "} } output x;");
+  // 0 entry, 1 loop head, 2 if, 3 then, 4 else, 5 if end, 6 loop exit
+  CFG cfg(std::move(blocks["global"]));
+  REQUIRE(cfg.size() == 7);
+
+  auto list = [](EdgeRange edges) {
+    return std::vector<int>(edges.begin(), edges.end());
+  };
+  CHECK(list(cfg.successors(0)) == std::vector<int>{1});
+  CHECK(list(cfg.successors(1)) == std::vector<int>{2, 6});
+  CHECK(list(cfg.successors(2)) == std::vector<int>{3, 4});
+  CHECK(list(cfg.successors(3)) == std::vector<int>{5});
+  CHECK(list(cfg.successors(5)) == std::vector<int>{1});
+  CHECK(cfg.successors(6).empty());
+  CHECK(list(cfg.predecessors(1)) == std::vector<int>{0, 5});
+  CHECK(list(cfg.predecessors(5)) == std::vector<int>{3, 4});
+}
+
+TEST_CASE("Dominators and loops", "[ir]") {
+  auto blocks = blocksFor(
+      "x := 0; while (x < 10) { if (x < 5) { while (y < x) { y := y + 1; } "
+      "} else { x := x + 1; } x := x + 1; } output x;");
+  // 0 entry, 1 outer head, 2 if, 3 inner head, 4 inner body, 5 jump to
+  // if end, 6 else, 7 if end, 8 exit
+  CFG cfg(std::move(blocks["global"]));
+  REQUIRE(cfg.size() == 9);
+
+  auto list = [](EdgeRange edges) {
+    return std::vector<int>(edges.begin(), edges.end());
+  };
+  CHECK(cfg.idom(0) == -1);
+  CHECK(cfg.idom(1) == 0);
+  CHECK(cfg.idom(3) == 2);
+  CHECK(cfg.idom(7) == 2);
+  CHECK(cfg.idom(8) == 1);
+  CHECK(list(cfg.domChildren(2)) == std::vector<int>{3, 6, 7});
+  CHECK(cfg.dominates(1, 4));
+  CHECK(cfg.dominates(4, 4));
+  CHECK(!cfg.dominates(3, 7));
+  CHECK(list(cfg.dominanceFrontier(4)) == std::vector<int>{3});
+  CHECK(list(cfg.dominanceFrontier(6)) == std::vector<int>{7});
+  CHECK(list(cfg.dominanceFrontier(7)) == std::vector<int>{1});
+
+  const auto& loops = cfg.loops();
+  REQUIRE(loops.size() == 2);
+  CHECK(loops[0].header == 1);
+  CHECK(loops[0].depth == 1);
+  CHECK(loops[0].blocks == std::vector<int>{1, 2, 3, 4, 5, 6, 7});
+  CHECK(loops[1].header == 3);
+  CHECK(loops[1].parent == 0);
+  CHECK(loops[1].latches == std::vector<int>{4});
+  CHECK(cfg.loopDepth(4) == 2);
+  CHECK(cfg.loopDepth(6) == 1);
+  CHECK(cfg.loopDepth(8) == 0);
+
+  // replacing the blocks drops the cached results
+  std::vector<BasicBlock> straight;
+  straight.push_back(BasicBlock({Instruction(Opcode::output, Operand(1))}, 0));
+  cfg.setBlocks(std::move(straight));
+  CHECK(cfg.loops().empty());
+  CHECK(cfg.reversePostorder() == std::vector<int>{0});
+}
+
+namespace {
+
+// The blocks of "x := 0;" followed by n copies of
+// "while (x < 10) { if (x < 5) { x := x + 2; } else { x := x + 1; } }",
+// built directly rather than through the lexer to keep the test fast
+std::vector<BasicBlock> manyLoops(int n) {
+  auto x = Operand("x", OperandType::Var);
+  auto t = Operand(NameKind::Tmp, 0, OperandType::Var);
+  std::vector<Instruction> insns{Instruction(x, Operand(0))};
+  for (int i = 0; i < n; ++i) {
+    auto start = Operand(NameKind::WhileStart, i, OperandType::Label);
+    auto end = Operand(NameKind::WhileEnd, i, OperandType::Label);
+    auto elseLabel = Operand(NameKind::IfFalse, i, OperandType::Label);
+    auto join = Operand(NameKind::IfEnd, i, OperandType::Label);
+    insns.insert(insns.end(),
+                 {Instruction(start),
+                  Instruction(t, Opcode::LT, x, Operand(10)),
+                  Instruction(t, Opcode::jump_conditional, end),
+                  Instruction(t, Opcode::LT, x, Operand(5)),
+                  Instruction(t, Opcode::jump_conditional, elseLabel),
+                  Instruction(x, Opcode::ADD, x, Operand(2)),
+                  Instruction(Opcode::jump_unconditional, join),
+                  Instruction(elseLabel),
+                  Instruction(x, Opcode::ADD, x, Operand(1)),
+                  Instruction(join),
+                  Instruction(Opcode::jump_unconditional, start),
+                  Instruction(end)});
+  }
+  insns.push_back(Instruction(Opcode::output, x));
+  return IR().getBB(insns);
+}
+
+}  // namespace
+
+TEST_CASE("Dominators scale to 100k blocks", "[ir]") {
+  CFG cfg(manyLoops(17000));
+  REQUIRE(cfg.size() > 100000);
+
+  // loop i has its head at 6i + 1 and its exit block (just the end label)
+  // at 6i + 6, which falls through into the next head
+  int last = 6 * 16999 + 1;
+  CHECK(cfg.reversePostorder().size() == cfg.size());
+  CHECK(cfg.idom(last) == last - 1);
+  CHECK(cfg.idom(last - 1) == last - 6);
+  CHECK(cfg.dominates(1, last + 5));
+  CHECK(cfg.loops().size() == 17000);
+  CHECK(cfg.loopDepth(last + 2) == 1);
+}
+
+TEST_CASE("Local value numbering", "[ir][passes]") {
+  SECTION("commutative recomputation becomes a copy") {
+    auto program = compile(
+        "a := foo(); b := foo(); c := a + b; d := b + a; output c * d;");
+    auto& cfg = *program.functions["global"];
+    REQUIRE(countOpcode(cfg, Opcode::ADD) == 2);
+    CHECK(localValueNumbering(cfg));
+    CHECK(countOpcode(cfg, Opcode::ADD) == 1);
+  }
+
+  SECTION("reassignment ends a value's lifetime") {
+    auto program =
+        compile("a := foo(); c := a + 1; a := 5; d := a + 1; output c * d;");
+    auto& cfg = *program.functions["global"];
+    localValueNumbering(cfg);
+    CHECK(countOpcode(cfg, Opcode::ADD) == 1);  // a + 1 itself is folded
+    CHECK(Interpreter(program).run() == 6);
+  }
+
+  SECTION("constants are folded") {
+    auto program = compile(
+        "x := 3 * 4 + 2; if (! x < 10) { y := 1; } else { y := 0; } "
+        "output y;");
+    auto& cfg = *program.functions["global"];
+    auto before = program.instructionCount();
+    localValueNumbering(cfg);
+    CHECK(countOpcode(cfg, Opcode::MUL) == 0);
+    CHECK(countOpcode(cfg, Opcode::ADD) == 0);
+    CHECK(countOpcode(cfg, Opcode::NOT) == 0);
+    CHECK(program.instructionCount() < before);
+    CHECK(Interpreter(program).run() == 1);
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    checkTestsPreserveOutput(
+        [](Module& program) {
+          auto before = program.instructionCount();
+          for (auto& [name, cfg] : program.functions) {
+            localValueNumbering(*cfg);
+          }
+          CHECK(program.instructionCount() <= before);
+        },
+        [](const Interpreter& reference, const Interpreter& optimized) {
+          CHECK(optimized.executed <= reference.executed);
+        });
+  }
+}
+
+TEST_CASE("SSA construction and destruction", "[ir][passes]") {
+  SECTION("phis only for variables live at the join") {
+    auto program = compile(
+        "x := 1; if (c < 1) { x := 2; y := 3; } else { y := 4; } output x;");
+    auto& cfg = *program.functions["global"];
+    CHECK(constructSSA(cfg));
+    CHECK(isSingleAssignment(cfg));
+    REQUIRE(countPhis(cfg) == 1);
+    const auto& join = cfg.getBlocks().back();
+    REQUIRE(join.phis().size() == 1);
+    CHECK(join.phis()[0].lhs.base() == Operand("x", OperandType::Var));
+    CHECK(join.instructions().back().getOperand0() == join.phis()[0].lhs);
+    CHECK(Interpreter(program).run() == 2);
+  }
+
+  SECTION("a loop at the entry gets a preheader") {
+    auto program = compile("while (x < 10) { x := x + 1; } output x;");
+    auto& cfg = *program.functions["global"];
+    constructSSA(cfg);
+    CHECK(cfg.predecessors(0).empty());
+    CHECK(isSingleAssignment(cfg));
+    CHECK(Interpreter(program).run() == 10);
+    CHECK(destructSSA(cfg));
+    CHECK(countPhis(cfg) == 0);
+    CHECK(Interpreter(program).run() == 10);
+  }
+
+  SECTION("swapping phis are sequentialized through a temporary") {
+    // a and b trade values on every trip around the loop
+    auto a = Operand("a", OperandType::Var);
+    auto b = Operand("b", OperandType::Var);
+    auto i = Operand("i", OperandType::Var);
+    auto t = Operand(NameKind::Tmp, 0, OperandType::Var);
+    auto start = Operand(NameKind::WhileStart, 0, OperandType::Label);
+    auto end = Operand(NameKind::WhileEnd, 0, OperandType::Label);
+    auto a1 = a.newVersion(), a2 = a.newVersion();
+    auto b1 = b.newVersion(), b2 = b.newVersion();
+    auto i1 = i.newVersion(), i2 = i.newVersion(), i3 = i.newVersion();
+    Module program;
+    program.functions["global"] = std::make_unique<CFG>(IR().getBB({
+        Instruction(a1, Operand(1)),
+        Instruction(b1, Operand(2)),
+        Instruction(i1, Operand(0)),
+        Instruction(start),
+        Instruction(t, Opcode::LT, i2, Operand(3)),
+        Instruction(t, Opcode::jump_conditional, end),
+        Instruction(i3, Opcode::ADD, i2, Operand(1)),
+        Instruction(Opcode::jump_unconditional, start),
+        Instruction(end),
+        Instruction(t, Opcode::MUL, a2, Operand(10)),
+        Instruction(t, Opcode::ADD, t, b2),
+        Instruction(Opcode::output, t),
+    }));
+    auto& cfg = *program.functions["global"];
+    REQUIRE(cfg.size() == 4);
+    cfg.getBlock(1).setPhis(
+        {Phi{a2, {a1, b2}}, Phi{b2, {b1, a2}}, Phi{i2, {i1, i3}}});
+    REQUIRE(Interpreter(program).run() == 21);
+
+    CHECK(destructSSA(cfg));
+    CHECK(countPhis(cfg) == 0);
+    CHECK(Interpreter(program).run() == 21);
+    // the latch copies a2 and b2 into each other, which takes three copies
+    CHECK(countOpcode(cfg, Opcode::NIL) == 3 + 3 + 3 + 1);
+  }
+
+  SECTION("critical edges are split") {
+    // the phi's block is reached from the branch, by falling through or
+    // by its jump, and from one other block
+    auto x = Operand("x", OperandType::Var);
+    auto c = Operand("c", OperandType::Var);
+    auto t = Operand(NameKind::Tmp, 0, OperandType::Var);
+    auto join = Operand(NameKind::IfEnd, 0, OperandType::Label);
+    auto other = Operand(NameKind::IfFalse, 0, OperandType::Label);
+    auto x0 = x.newVersion(), x1 = x.newVersion(), x2 = x.newVersion();
+    for (bool fallthrough : {true, false}) {
+      for (int input : {0, 5}) {
+        std::vector<Instruction> insns{
+            Instruction(c, Operand(input)), Instruction(x0, Operand(1)),
+            Instruction(t, Opcode::LT, c, Operand(1)),
+            Instruction(t, Opcode::jump_conditional,
+                        fallthrough ? other : join)};
+        if (fallthrough) {
+          insns.insert(insns.end(), {Instruction(join),
+                                     Instruction(Opcode::output, x2),
+                                     Instruction(other),
+                                     Instruction(x1, Operand(2)),
+                                     Instruction(Opcode::jump_unconditional,
+                                                 join)});
+        } else {
+          insns.insert(insns.end(), {Instruction(x1, Operand(2)),
+                                     Instruction(join),
+                                     Instruction(Opcode::output, x2)});
+        }
+        Module program;
+        program.functions["global"] =
+            std::make_unique<CFG>(IR().getBB(insns));
+        auto& cfg = *program.functions["global"];
+        int phiBlock = fallthrough ? 1 : 2;
+        REQUIRE(cfg.predecessors(phiBlock).size() == 2);
+        cfg.getBlock(phiBlock).setPhis({Phi{x2, {x0, x1}}});
+        auto expected = Interpreter(program).run();
+        REQUIRE(expected == (fallthrough == (input == 0) ? 1 : 2));
+
+        auto blocks = cfg.size();
+        CHECK(destructSSA(cfg));
+        CHECK(cfg.size() == blocks + 1);
+        for (std::size_t b = 0; b < cfg.size(); ++b) {
+          for (int succ : cfg.successors(b)) {
+            CHECK((cfg.successors(b).size() == 1 ||
+                   cfg.predecessors(succ).size() == 1));
+          }
+        }
+        CHECK(Interpreter(program).run() == expected);
+      }
+    }
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    auto construct = [](Module& program) {
+      for (auto& [name, cfg] : program.functions) {
+        constructSSA(*cfg);
+        CHECK(isSingleAssignment(*cfg));
+      }
+    };
+    checkTestsPreserveOutput(construct);
+    checkTestsPreserveOutput([&](Module& program) {
+      construct(program);
+      for (auto& [name, cfg] : program.functions) {
+        destructSSA(*cfg);
+        CHECK(countPhis(*cfg) == 0);
+      }
+    });
+  }
+}
+
+TEST_CASE("Global value numbering", "[ir][passes]") {
+  SECTION("dominating values are reused across blocks and copies") {
+    auto program = compile(
+        "def f(int a, int b) : int { int c; int d; int e; c := a + b; "
+        "d := a; if (c < 10) { e := b + d; } else { e := 0; } "
+        "return e * c; } r := f(3, 4); output r;");
+    auto& cfg = *program.functions["f"];
+    REQUIRE(countOpcode(cfg, Opcode::ADD) == 2);
+    CHECK(globalValueNumbering(cfg));
+    CHECK(countOpcode(cfg, Opcode::ADD) == 1);
+    CHECK(countPhis(cfg) == 0);
+    CHECK(Interpreter(program).run() == 49);
+  }
+
+  SECTION("a value computed on every path is reused after the join") {
+    // neither branch dominates the other, but the phi merging them holds
+    // a + b on both paths
+    auto program = compile(
+        "def f(int a, int b) : int { int c; if (a < b) { c := a + b; } "
+        "else { c := b + a; } return c + (a + b); } r := f(1, 2); output r;");
+    auto& cfg = *program.functions["f"];
+    globalValueNumbering(cfg);
+    CHECK(countOpcode(cfg, Opcode::ADD) == 3);
+    CHECK(Interpreter(program).run() == 6);
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    checkTestsPreserveOutput([](Module& program) {
+      for (auto& [name, cfg] : program.functions) {
+        globalValueNumbering(*cfg);
+      }
+    });
+  }
+}
+
+TEST_CASE("Lazy code motion", "[ir][passes]") {
+  auto partial = [](int c) {
+    return "def f(int a, int b, int c) : int { int x; int y; "
+           "if (c < 1) { x := a + b; } else { x := 0; } y := a + b; "
+           "return x + y; } r := f(3, 4, " +
+           std::to_string(c) + "); output r;";
+  };
+
+  SECTION("a computation redundant on one path moves to the other") {
+    auto program = compile(partial(0));
+    auto& cfg = *program.functions["f"];
+    REQUIRE(countOpcode(cfg, Opcode::ADD) == 3);
+    CHECK(lazyCodeMotion(cfg));
+    // the join reads a + b from the branches, the else branch computes it
+    CHECK(countOpcode(cfg, Opcode::ADD) == 3);
+    const auto& join = cfg.getBlocks().back().instructions();
+    CHECK(std::count_if(join.begin(), join.end(), [](const auto& instr) {
+            return instr.getOpcode() == Opcode::ADD;
+          }) == 1);
+    for (int c : {0, 5}) {
+      auto original = compile(partial(c));
+      auto optimized = compile(partial(c));
+      lazyCodeMotion(*optimized.functions["f"]);
+      Interpreter reference(original);
+      Interpreter moved(optimized);
+      CHECK(moved.run() == reference.run());
+      CHECK(moved.computed == reference.computed - (c < 1 ? 1 : 0));
+    }
+  }
+
+  SECTION("a loop body reuses a value computed ahead of the loop") {
+    auto program = compile(
+        "def f(int a, int b, int n) : int { int i; int s; i := 0; "
+        "s := a * b; while (i < n) { s := s + a * b; i := i + 1; } "
+        "return s; } r := f(3, 4, 6); output r;");
+    auto& cfg = *program.functions["f"];
+    Interpreter before(program);
+    auto expected = before.run();
+    auto computed = before.computed;
+    CHECK(lazyCodeMotion(cfg));
+    CHECK(countOpcode(cfg, Opcode::MUL) == 1);
+    Interpreter after(program);
+    CHECK(after.run() == expected);
+    CHECK(after.computed == computed - 6);
+  }
+
+  SECTION("nothing is hoisted onto a path that did not compute it") {
+    // the loop may run zero times, so a * b must stay inside it
+    auto program = compile(
+        "def f(int a, int b, int n) : int { int i; int s; i := 0; s := 0; "
+        "while (i < n) { s := s + a * b; i := i + 1; } return s; } "
+        "r := f(3, 4, 0); output r;");
+    auto& cfg = *program.functions["f"];
+    Interpreter before(program);
+    auto expected = before.run();
+    lazyCodeMotion(cfg);
+    Interpreter after(program);
+    CHECK(after.run() == expected);
+    CHECK(after.computed == before.computed);
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    checkTestsPreserveOutput(
+        [](Module& program) {
+          for (auto& [name, cfg] : program.functions) {
+            lazyCodeMotion(*cfg);
+          }
+        },
+        [](const Interpreter& reference, const Interpreter& optimized) {
+          CHECK(optimized.computed <= reference.computed);
+        });
+  }
+}
+
+TEST_CASE("Sparse conditional constant propagation", "[ir][passes]") {
+  SECTION("a constant branch folds and its dead side goes away") {
+    auto program = compile(
+        "int x; int y; int z; x := 1; "
+        "if (x < 2) { y := 10; } else { y := 20; } z := y + 1; output z;");
+    auto& cfg = *program.functions["global"];
+    auto blocks = cfg.size();
+    CHECK(sparseConditionalConstantPropagation(cfg));
+    CHECK(countOpcode(cfg, Opcode::jump_conditional) == 0);
+    CHECK(countOpcode(cfg, Opcode::LT) == 0);
+    CHECK(countOpcode(cfg, Opcode::ADD) == 0);
+    CHECK(cfg.size() < blocks);
+    Interpreter after(program);
+    CHECK(after.run() == 11);
+  }
+
+  SECTION("constants survive loops whose other paths never run") {
+    // x only changes on the else side, which x = 1 never reaches
+    auto program = compile(
+        "def f(int n) : int { int x; int i; x := 1; i := 0; "
+        "while (i < n) { if (x = 1) { i := i + 1; } else { x := 2; } } "
+        "return x; } r := f(4); output r;");
+    auto& cfg = *program.functions["f"];
+    Interpreter before(program);
+    REQUIRE(before.run() == 1);
+    sparseConditionalConstantPropagation(cfg);
+    CHECK(countOpcode(cfg, Opcode::EQ) == 0);
+    CHECK(countOpcode(cfg, Opcode::jump_conditional) == 1);
+    const auto& exit = cfg.getBlocks().back().instructions().back();
+    CHECK(exit.getOpcode() == Opcode::ret);
+    CHECK(exit.getOperand0() == Operand(1));
+    Interpreter after(program);
+    CHECK(after.run() == 1);
+    CHECK(after.computed < before.computed);
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    checkTestsPreserveOutput(
+        [](Module& program) {
+          for (auto& [name, cfg] : program.functions) {
+            sparseConditionalConstantPropagation(*cfg);
+          }
+        },
+        [](const Interpreter& reference, const Interpreter& optimized) {
+          CHECK(optimized.computed <= reference.computed);
+        });
+  }
+}
+
+TEST_CASE("Copy propagation", "[ir][passes]") {
+  auto reads = [](const CFG& cfg, const Operand& var) {
+    int n = 0;
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        instr.forEachUse([&](const Operand& use) { n += use == var; });
+      }
+    }
+    return n;
+  };
+  auto temporaries = [](const CFG& cfg) {
+    int n = 0;
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        n += instr.isDefinition() && instr.getOperand0().isTemporary();
+      }
+    }
+    return n;
+  };
+  Operand x("x", OperandType::Var);
+  Operand y("y", OperandType::Var);
+
+  SECTION("temporaries coalesce into the assigned variable") {
+    auto program = compile(
+        "def f(int a) : int { int x; int y; x := a; y := x + 1; return y; } "
+        "r := f(4); output r;");
+    auto& cfg = *program.functions["f"];
+    CHECK(propagateCopies(cfg));
+    CHECK(temporaries(cfg) == 0);
+    CHECK(reads(cfg, x) == 0);
+    CHECK(countOpcode(cfg, Opcode::ADD) == 1);
+    Interpreter after(program);
+    CHECK(after.run() == 5);
+  }
+
+  SECTION("copies reach across blocks unless a path reassigns them") {
+    auto program = compile(
+        "def f(int a, int c) : int { int x; int y; x := a; "
+        "if (c < 1) { y := x * 2; } else { y := x * 3; } y := y + x; "
+        "x := a; if (c < 1) { x := 7; } else { y := y - 1; } "
+        "return x + y; } r := f(5, 0); output r;");
+    auto& cfg = *program.functions["f"];
+    Interpreter before(program);
+    auto expected = before.run();
+    propagateCopies(cfg);
+    // the branches and the join read a, the final x + y still reads x
+    CHECK(reads(cfg, x) == 1);
+    Interpreter after(program);
+    CHECK(after.run() == expected);
+  }
+
+  SECTION("programs in tests/ compute the same output with fewer "
+          "instructions") {
+    std::size_t before = 0, after = 0;
+    checkTestsPreserveOutput(
+        [&](Module& program) {
+          for (auto& [name, cfg] : program.functions) {
+            auto count = cfg->instructionCount();
+            propagateCopies(*cfg);
+            CHECK(cfg->instructionCount() <= count);
+            before += count;
+            after += cfg->instructionCount();
+          }
+        },
+        [](const Interpreter& reference, const Interpreter& optimized) {
+          CHECK(optimized.executed <= reference.executed);
+        });
+    CHECK(after * 10 < before * 9);
+  }
+}
+
+TEST_CASE("Dead code elimination", "[ir][passes]") {
+  SECTION("assignments overwritten before any read go away") {
+    auto program = compile(
+        "int x; int y; x := 1; y := x + 4; x := 2; y := 3; output x;");
+    auto& cfg = *program.functions["global"];
+    CHECK(eliminateDeadCode(cfg));
+    CHECK(countOpcode(cfg, Opcode::ADD) == 0);
+    CHECK(cfg.instructionCount() == 2);
+    Interpreter after(program);
+    CHECK(after.run() == 2);
+  }
+
+  SECTION("liveness follows the loop around and keeps calls") {
+    auto program = compile(
+        "def g(int a) : int { return a; } "
+        "def f(int n) : int { int i; int s; int d; int u; i := 0; s := 0; "
+        "while (i < n) { d := i * 2; s := s + i; i := i + 1; } "
+        "u := g(s); return s; } r := f(5); output r;");
+    auto& cfg = *program.functions["f"];
+    auto calls = countOpcode(cfg, Opcode::CALL);
+    CHECK(eliminateDeadCode(cfg));
+    CHECK(countOpcode(cfg, Opcode::MUL) == 0);
+    CHECK(countOpcode(cfg, Opcode::ADD) == 2);
+    CHECK(countOpcode(cfg, Opcode::CALL) == calls);
+    Interpreter after(program);
+    CHECK(after.run() == 10);
+  }
+
+  SECTION("a deletion that leaves an earlier block's code dead is followed "
+          "up") {
+    // a + 1 is dead in the then block, and once it goes a := 1 is too
+    auto program = compile(
+        "int a; int b; a := 1; b := 2; if (b < 3) { a := a + 1; } output b;");
+    auto& cfg = *program.functions["global"];
+    CHECK(eliminateDeadCode(cfg));
+    CHECK(countOpcode(cfg, Opcode::ADD) == 0);
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        CHECK(instr.toString().rfind("a <-", 0) != 0);
+      }
+    }
+    CHECK_FALSE(eliminateDeadCode(cfg));
+    Interpreter after(program);
+    CHECK(after.run() == 2);
+  }
+
+  SECTION("instruction level liveness matches the block sets") {
+    auto program = compile(readFile("tests/ex5.l1"));
+    for (auto& [name, cfg] : program.functions) {
+      Liveness live(*cfg);
+      for (std::size_t b = 0; b < cfg->size(); ++b) {
+        BitVector set = live.liveOut(b);
+        const auto& instrs = cfg->getBlocks()[b].instructions();
+        for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+          live.transfer(*it, set);
+        }
+        CHECK(set == live.liveIn(b));
+      }
+    }
+  }
+
+  SECTION("copy propagation and DCE reach a fixed point on tests/") {
+    checkTestsPreserveOutput(
+        [](Module& program) {
+          for (auto& [name, cfg] : program.functions) {
+            auto before = cfg->instructionCount();
+            while (propagateCopies(*cfg) || eliminateDeadCode(*cfg)) {
+            }
+            CHECK_FALSE(eliminateDeadCode(*cfg));
+            CHECK(cfg->instructionCount() <= before);
+          }
+        },
+        [](const Interpreter& reference, const Interpreter& optimized) {
+          CHECK(optimized.executed <= reference.executed);
+        });
+  }
+}
+
+TEST_CASE("Loop-invariant code motion", "[ir][passes]") {
+  auto inLoops = [](const CFG& cfg, Opcode op) {
+    int n = 0;
+    std::vector<bool> counted(cfg.size(), false);
+    for (const auto& loop : cfg.loops()) {
+      for (int b : loop.blocks) {
+        if (counted[b]) {
+          continue;
+        }
+        counted[b] = true;
+        for (const auto& instr : cfg.getBlocks()[b].instructions()) {
+          n += !instr.isLabel() && instr.getOpcode() == op;
+        }
+      }
+    }
+    return n;
+  };
+
+  SECTION("invariant operations leave a while loop through its preheader") {
+    auto program = compile(
+        "def f(int a, int b, int n) : int { int i; int s; i := 0; s := 0; "
+        "while (i < n) { s := s + a * b; i := i + 1; } return s; } "
+        "r := f(3, 4, 5); output r;");
+    auto& cfg = *program.functions["f"];
+    Interpreter before(program);
+    REQUIRE(before.run() == 60);
+    CHECK(hoistLoopInvariants(cfg));
+    REQUIRE(cfg.loops().size() == 1);
+    int preheader = cfg.preheader(0);
+    REQUIRE(preheader >= 0);
+    CHECK(inLoops(cfg, Opcode::MUL) == 0);
+    CHECK(inLoops(cfg, Opcode::ADD) == 2);
+    Interpreter after(program);
+    CHECK(after.run() == 60);
+    CHECK(after.computed == before.computed - 4);
+  }
+
+  SECTION("inner loops go first so invariants leave the whole nest") {
+    auto program = compile(
+        "def f(int a, int b, int n) : int { int i; int j; int s; i := 0; "
+        "s := 0; while (i < n) { j := 0; while (j < n) { "
+        "s := s + a * b; j := j + 1; } i := i + 1; } return s; } "
+        "r := f(3, 4, 4); output r;");
+    auto& cfg = *program.functions["f"];
+    Interpreter before(program);
+    REQUIRE(before.run() == 192);
+    CHECK(hoistLoopInvariants(cfg));
+    CHECK(cfg.loops().size() == 2);
+    CHECK(inLoops(cfg, Opcode::MUL) == 0);
+    Interpreter after(program);
+    CHECK(after.run() == 192);
+    CHECK(after.computed == before.computed - 15);
+  }
+
+  SECTION("a value read after a loop that may not run stays in it") {
+    auto program = compile(
+        "def f(int a, int b, int n) : int { int i; int x; i := 0; x := 1; "
+        "while (i < n) { x := a * b; i := i + 1; } return x; } "
+        "r := f(3, 4, 0); output r;");
+    auto& cfg = *program.functions["f"];
+    // coalesced, a * b is computed straight into x
+    propagateCopies(cfg);
+    hoistLoopInvariants(cfg);
+    CHECK(inLoops(cfg, Opcode::MUL) == 1);
+    Interpreter after(program);
+    CHECK(after.run() == 1);
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    checkTestsPreserveOutput(
+        [](Module& program) {
+          for (auto& [name, cfg] : program.functions) {
+            hoistLoopInvariants(*cfg);
+            for (std::size_t l = 0; l < cfg->loops().size(); ++l) {
+              CHECK(cfg->preheader(l) >= 0);
+            }
+          }
+        },
+        [](const Interpreter& reference, const Interpreter& optimized) {
+          CHECK(optimized.computed <= reference.computed);
+        });
+  }
+}
+
+TEST_CASE("Strength reduction", "[ir][passes]") {
+  auto optimize = [](CFG& cfg) {
+    propagateCopies(cfg);
+    bool changed = reduceStrength(cfg);
+    while (propagateCopies(cfg) || eliminateDeadCode(cfg)) {
+    }
+    return changed;
+  };
+
+  SECTION("products of the induction variable become additions") {
+    auto program = compile(
+        "def f(int n) : int { int i; int s; i := 0; s := 0; "
+        "while (i < 10) { s := s + i * 3; i := i + 1; } return s + n; } "
+        "r := f(2); output r;");
+    auto& cfg = *program.functions["f"];
+    Interpreter before(program);
+    REQUIRE(before.run() == 137);
+    CHECK(optimize(cfg));
+    CHECK(countOpcode(cfg, Opcode::MUL) == 1);  // in the preheader
+    // the exit test reads the reduced variable, so i is gone
+    Operand i("i", OperandType::Var);
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        CHECK(!(instr.isDefinition() && instr.getOperand0() == i &&
+                instr.getOpcode() == Opcode::ADD));
+      }
+    }
+    Interpreter after(program);
+    CHECK(after.run() == 137);
+    CHECK(after.executed < before.executed);
+  }
+
+  SECTION("the test stays when the bound is unknown") {
+    auto program = compile(
+        "def f(int n, int k) : int { int i; int s; i := n; s := 0; "
+        "while (0 < i) { s := s + i * k; i := i - 2; } return s; } "
+        "r := f(9, 5); output r;");
+    auto& cfg = *program.functions["f"];
+    Interpreter before(program);
+    auto expected = before.run();
+    CHECK(optimize(cfg));
+    CHECK(countOpcode(cfg, Opcode::LT) == 1);
+    Interpreter after(program);
+    CHECK(after.run() == expected);
+  }
+
+  SECTION("products that could overflow keep the original test") {
+    auto program = compile(
+        "def f(int n) : int { int i; int s; i := 0; s := 0; "
+        "while (i < 100000) { s := i * 100000; i := i + 1; } return s; } "
+        "r := f(0); output r;");
+    auto& cfg = *program.functions["f"];
+    Interpreter before(program);
+    auto expected = before.run();
+    optimize(cfg);
+    Interpreter after(program);
+    CHECK(after.run() == expected);
+    bool testsI = false;
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        testsI |= instr.getOpcode() == Opcode::LT &&
+                  instr.getOperand1() == Operand("i", OperandType::Var);
+      }
+    }
+    CHECK(testsI);
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    checkTestsPreserveOutput([&](Module& program) {
+      for (auto& [name, cfg] : program.functions) {
+        optimize(*cfg);
+      }
+    });
+  }
+}
+
+TEST_CASE("Call graph", "[ir][passes]") {
+  auto program = compile(
+      "def even(int n) : int { int r; if (n = 0) { r := 1; } else { "
+      "r := odd(n - 1); } return r; } "
+      "def odd(int n) : int { int r; if (n = 0) { r := 0; } else { "
+      "r := even(n - 1); } return r; } "
+      "def sq(int x) : int { return x * x; } "
+      "def f(int x) : int { int a; a := sq(x); a := even(a); return a; } "
+      "r := f(3); output r;");
+  CallGraph graph(program);
+  REQUIRE(graph.size() == 5);
+  int even = graph.find("even"), odd = graph.find("odd");
+  int sq = graph.find("sq"), f = graph.find("f"), global = graph.find("global");
+  CHECK(graph.find("missing") == -1);
+  CHECK(graph.callees(f).size() == 2);
+  CHECK(graph.component(even) == graph.component(odd));
+  CHECK(graph.isRecursive(even));
+  CHECK(graph.isRecursive(odd));
+  CHECK(!graph.isRecursive(sq));
+  CHECK(!graph.isRecursive(f));
+  // callees first
+  CHECK(graph.component(sq) < graph.component(f));
+  CHECK(graph.component(even) < graph.component(f));
+  CHECK(graph.component(f) < graph.component(global));
+  CHECK(graph.components().size() == 4);
+}
+
+TEST_CASE("Function inlining", "[ir][passes]") {
+  auto reoptimize = [](CFG& cfg) {
+    while (propagateCopies(cfg) || eliminateDeadCode(cfg)) {
+    }
+  };
+
+  SECTION("small callees in a loop are inlined") {
+    auto program = compile(
+        "def sq(int x) : int { return x * x; } "
+        "def f(int n) : int { int i; int s; int t; i := 0; s := 0; "
+        "while (i < n) { t := sq(i); s := s + t; i := i + 1; } return s; } "
+        "r := f(10); output r;");
+    Interpreter before(program);
+    REQUIRE(before.run() == 285);
+    CHECK(inlineCalls(program, 10, reoptimize));
+    CHECK(countOpcode(*program.functions["f"], Opcode::CALL) == 0);
+    CHECK(countOpcode(*program.functions["global"], Opcode::CALL) == 0);
+    Interpreter after(program);
+    CHECK(after.run() == 285);
+    CHECK(after.executed < before.executed);
+  }
+
+  SECTION("callee variables read before assignment start at 0") {
+    auto program = compile(
+        "def g(int x) : int { int y; y := y + x; return y; } "
+        "a := 5; b := g(a); c := g(b); output c;");
+    CHECK(inlineCalls(program, 10));
+    CHECK(countOpcode(*program.functions["global"], Opcode::CALL) == 0);
+    CHECK(Interpreter(program).run() == 5);
+  }
+
+  SECTION("recursive and large callees stay calls") {
+    auto program = compile(readFile("tests/recursion.l1"));
+    CHECK(!inlineCalls(program, 1000));
+    CHECK(countOpcode(*program.functions["fact"], Opcode::CALL) == 1);
+    CHECK(countOpcode(*program.functions["global"], Opcode::CALL) == 1);
+
+    program = compile(
+        "def sq(int x) : int { return x * x; } r := sq(4); output r;");
+    CHECK(!inlineCalls(program, 1));
+    CHECK(countOpcode(*program.functions["global"], Opcode::CALL) == 1);
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    checkTestsPreserveOutput(
+        [&](Module& program) { inlineCalls(program, 40, reoptimize); });
+  }
+}
+
+TEST_CASE("Tail-recursion elimination", "[ir][passes]") {
+  SECTION("an accumulated product becomes a loop") {
+    auto program = compile(readFile("tests/recursion.l1"));
+    Interpreter before(program);
+    REQUIRE(before.run() == 120);
+    CHECK(eliminateTailRecursion(program));
+    CHECK(countOpcode(*program.functions["fact"], Opcode::CALL) == 0);
+    Interpreter after(program);
+    CHECK(after.run() == 120);
+    CHECK(after.executed < before.executed);
+  }
+
+  SECTION("a returned call becomes a jump") {
+    auto program = compile(
+        "def sum(int n, int s) : int { int r; if (n = 0) { r := s; } "
+        "else { r := sum(n - 1, s + n); } return r; } "
+        "r := sum(100, 0); output r;");
+    CHECK(eliminateTailRecursion(program));
+    CHECK(countOpcode(*program.functions["sum"], Opcode::CALL) == 0);
+    CHECK(Interpreter(program).run() == 5050);
+  }
+
+  SECTION("the last of several calls is accumulated") {
+    auto program = compile(
+        "def fib(int n) : int { int r; int a; int b; if (n < 2) { r := n; } "
+        "else { a := fib(n - 1); b := fib(n - 2); r := a + b; } return r; } "
+        "r := fib(15); output r;");
+    CHECK(eliminateTailRecursion(program));
+    CHECK(countOpcode(*program.functions["fib"], Opcode::CALL) == 1);
+    CHECK(Interpreter(program).run() == 610);
+  }
+
+  SECTION("each iteration starts from zeroed variables") {
+    auto program = compile(
+        "def f(int n) : int { int y; int r; y := y + n; if (n = 0) { "
+        "r := y; } else { r := f(n - 1); } return r; } "
+        "r := f(3); output r;");
+    CHECK(eliminateTailRecursion(program));
+    CHECK(Interpreter(program).run() == 0);
+  }
+
+  SECTION("other uses of the result keep the call") {
+    auto program = compile(
+        "def f(int n) : int { int r; if (n = 0) { r := 0; } else { "
+        "r := f(n - 1); r := r - n; } return r; } "
+        "r := f(4); output r;");
+    CHECK(!eliminateTailRecursion(program));
+    CHECK(countOpcode(*program.functions["f"], Opcode::CALL) == 1);
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    checkTestsPreserveOutput(
+        [](Module& program) { eliminateTailRecursion(program); });
+  }
+}
+
+TEST_CASE("Short-circuit guards", "[ir]") {
+  auto count = [](const Module& program, Opcode op) {
+    return countOpcode(*program.functions.at("global"), op);
+  };
+
+  SECTION("&& and || become jumps") {
+    auto source =
+        "x := 3; y := 0; if ([x < 5] && [[1 < y] || [! x <= 2]]) { "
+        "y := 7; } else { y := 8; } output y;";
+    auto plain = compile(source);
+    auto program = compile(source, true);
+    CHECK(count(plain, Opcode::AND) == 1);
+    CHECK(count(program, Opcode::AND) == 0);
+    CHECK(count(program, Opcode::OR) == 0);
+    CHECK(count(program, Opcode::NOT) == 0);
+    CHECK(Interpreter(program).run() == 7);
+  }
+
+  SECTION("the right operand is skipped once the left decides") {
+    auto source =
+        "i := 0; n := 0; while (i < 100) { if ([i < 50] || [i * i < 100]) "
+        "{ n := n + 1; } i := i + 1; } output n;";
+    auto original = compile(source);
+    auto program = compile(source, true);
+    Interpreter plain(original);
+    Interpreter shortCircuit(program);
+    REQUIRE(plain.run() == 50);
+    CHECK(shortCircuit.run() == 50);
+    CHECK(shortCircuit.computed < plain.computed);
+  }
+
+  SECTION("loop guards exit on either side") {
+    auto program = compile(
+        "i := 0; j := 10; while ([i < 8] && [! j <= i]) { i := i + 1; "
+        "j := j - 1; "
+        "} output i * 100 + j;",
+        true);
+    CHECK(Interpreter(program).run() == 505);
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    checkTestsPreserveOutput([](Module&) {}, nullptr, true);
+  }
+}
+
+TEST_CASE("Control flow simplification", "[ir][passes]") {
+  // whether some jump leads to a block that does nothing but jump on
+  auto jumpsToJump = [](const CFG& cfg) {
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      for (int succ : cfg.successors(b)) {
+        const auto& instrs = cfg.getBlocks()[succ].instructions();
+        if (instrs.size() == 2 &&
+            instrs.back().getOpcode() == Opcode::jump_unconditional &&
+            static_cast<int>(b) + 1 != succ) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
+  SECTION("jumps to jumps are threaded") {
+    auto program = compile(
+        "x := 0; y := 0; if (x < 1) { if (y < 1) { z := 1; } else { "
+        "z := 2; } } else { z := 3; } output z;");
+    auto& cfg = *program.functions["global"];
+    REQUIRE(jumpsToJump(cfg));
+    auto before = cfg.size();
+    CHECK(simplifyControlFlow(cfg));
+    CHECK(!jumpsToJump(cfg));
+    CHECK(cfg.size() < before);
+    CHECK(Interpreter(program).run() == 1);
+  }
+
+  SECTION("unreachable blocks go and straight-line blocks merge") {
+    auto x = Operand("x", OperandType::Var);
+    auto y = Operand("y", OperandType::Var);
+    auto skip = Operand(NameKind::IfEnd, 0, OperandType::Label);
+    auto join = Operand(NameKind::IfEnd, 1, OperandType::Label);
+    CFG cfg({BasicBlock({Instruction(x, Operand(1)),
+                         Instruction(Opcode::jump_unconditional, skip)},
+                        0),
+             BasicBlock({Instruction(y, Operand(2))}, 1),
+             BasicBlock({Instruction(skip), Instruction(y, x)}, 2),
+             BasicBlock({Instruction(join), Instruction(Opcode::output, y)},
+                        3)});
+    CHECK(simplifyControlFlow(cfg));
+    REQUIRE(cfg.size() == 1);
+    CHECK(cfg.getBlocks()[0].getBlockID() == 0);
+    CHECK(cfg.getBlocks()[0].instructions().size() == 3);
+    CHECK(!simplifyControlFlow(cfg));
+  }
+
+  SECTION("programs in tests/ compute the same output") {
+    checkTestsPreserveOutput(
+        [&](Module& program) {
+          for (auto& [name, cfg] : program.functions) {
+            auto before = cfg->size();
+            simplifyControlFlow(*cfg);
+            CHECK(cfg->size() <= before);
+            CHECK(!jumpsToJump(*cfg));
+          }
+        },
+        nullptr, true);
+  }
+}
+
+TEST_CASE("Pass manager", "[ir][passes]") {
+  auto text = [](const CFG& cfg) {
+    std::stringstream out;
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        out << instr << "\n";
+      }
+    }
+    return out.str();
+  };
+
+  SECTION("unknown passes are rejected") {
+    PassManager passes;
+    passes.add("lvn");
+    CHECK_THROWS_AS(passes.add("dce,nosuchpass"), PassError);
+    CHECK(passes.passes() == std::vector<std::string>{"lvn"});
+    auto names = passes.registeredPasses();
+    CHECK(std::is_sorted(names.begin(), names.end()));
+    for (int level = 0; level <= 2; ++level) {
+      CHECK_NOTHROW(PassManager().add(PassManager::pipeline(level)));
+    }
+  }
+
+  SECTION("analyses are kept until invalidated") {
+    auto program = compile(readFile("tests/ex3.l1"));
+    auto& cfg = *program.functions["global"];
+    FunctionAnalyses analyses(cfg);
+    const auto* live = &analyses.liveness();
+    CHECK(&analyses.liveness() == live);
+    analyses.solveAvailableExpressions();
+    CHECK(cfg.getAvailableExpressions().size() == cfg.size());
+    auto visits = cfg.getWorklistIterations();
+    analyses.solveAvailableExpressions();
+    CHECK(cfg.getWorklistIterations() == visits);
+    analyses.invalidate();
+    CHECK(analyses.liveness().variables().size() ==
+          live->variables().size());
+  }
+
+  SECTION("-O1 and GCSE alone keep programs in tests/ computing the same "
+          "output") {
+    checkTestsPreserveOutput([&](Module& program) {
+      std::map<std::string, CFG> manual;
+      for (const auto& [name, cfg] : program.functions) {
+        auto& copy = manual.emplace(name, cfg->getBlocks()).first->second;
+        simplifyControlFlow(copy);
+        localValueNumbering(copy);
+        copy.computeAvailExprs();
+        copy.computeGCSE();
+        while (propagateCopies(copy) || eliminateDeadCode(copy)) {
+        }
+        simplifyControlFlow(copy);
+      }
+      PassManager passes;
+      passes.add(PassManager::pipeline(1));
+      passes.run(program);
+      for (const auto& [name, cfg] : program.functions) {
+        CHECK(text(*cfg) == text(manual.at(name)));
+      }
+    });
+    checkTestsPreserveOutput([](Module& program) {
+      PassManager passes;
+      passes.add("gcse");
+      passes.run(program);
+    });
+  }
+
+  SECTION("GCSE reads the saved value and reports real replacements") {
+    auto program = compile(readFile("tests/ex4.l1"));
+    CHECK(Interpreter(program).run() == 86);
+    PassManager passes;
+    passes.add("gcse");
+    passes.run(program);
+    CHECK(Interpreter(program).run() == 86);
+    CHECK(passes.statistics()[0].changes == 1);
+
+    auto unique = compile("x := 1; y := x + 2; output y;");
+    PassManager none;
+    none.add("gcse");
+    CHECK(!none.run(unique));
+    CHECK(none.statistics()[0].changes == 0);
+  }
+
+  SECTION("a redefinition earlier in the block stops reuse") {
+    auto program = compile(
+        "a := 1; b := 2; x := a + b; if (x < 5) { y := 1; } else { y := 2; } "
+        "a := 10; z := a + b; output z;");
+    PassManager passes;
+    passes.add("gcse");
+    passes.run(program);
+    CHECK(Interpreter(program).run() == 12);
+  }
+
+  SECTION("analyses are solved again after GCSE") {
+    const std::string source =
+        "int a; int b; int x; a := 1; b := 2; x := a + b; output x;";
+    for (const auto& pipeline : {"dce,gcse,dce", "gcse,gcse"}) {
+      INFO(pipeline);
+      auto program = compile(source);
+      PassManager passes;
+      passes.add(pipeline);
+      passes.run(program);
+      CHECK(Interpreter(program).run() == 3);
+    }
+  }
+
+  SECTION("-O2 keeps programs in tests/ computing the same output") {
+    checkTestsPreserveOutput(
+        [](Module& program) {
+          auto before = static_cast<long>(program.instructionCount());
+          PassManager passes;
+          passes.add(PassManager::pipeline(2));
+          passes.run(program);
+          long delta = 0;
+          for (const auto& stat : passes.statistics()) {
+            CHECK(stat.runs ==
+                  (stat.name == "tailrec" || stat.name == "inline"
+                       ? 1
+                       : static_cast<int>(program.functions.size())));
+            delta += stat.instructionDelta;
+          }
+          CHECK(static_cast<long>(program.instructionCount()) - before ==
+                delta);
+        },
+        nullptr, true);
+  }
+
+  SECTION("a single function skips module passes") {
+    auto program = compile(readFile("tests/ex3.l1"));
+    PassManager passes;
+    passes.add("inline,lvn,simplify");
+    passes.run(*program.functions["global"]);
+    CHECK(passes.statistics()[0].runs == 0);
+    CHECK(passes.statistics()[1].runs == 1);
+    CHECK(passes.statistics()[2].changes == 1);
+  }
+}
+
+TEST_CASE("Parallel optimization", "[ir][passes]") {
+  SECTION("the pool runs every task and passes on failures") {
+    ThreadPool pool(4);
+    std::atomic<int> done{0};
+    for (int round = 0; round < 2; ++round) {
+      for (int i = 0; i < 1000; ++i) {
+        pool.submit([&] { ++done; });
+      }
+      pool.wait();
+      CHECK(done == 1000 * (round + 1));
+    }
+    pool.submit([] { throw IRError("failed"); });
+    pool.submit([&] { ++done; });
+    CHECK_THROWS_AS(pool.wait(), IRError);
+    CHECK(done == 2001);
+    CHECK_NOTHROW(pool.wait());
+  }
+
+  SECTION("tasks start in the order they were submitted") {
+    ThreadPool pool(1);
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    pool.submit([released] { released.wait(); });
+    std::vector<int> started;
+    for (int i = 0; i < 64; ++i) {
+      pool.submit([&, i] { started.push_back(i); });
+    }
+    release.set_value();
+    pool.wait();
+    REQUIRE(started.size() == 64);
+    CHECK(std::is_sorted(started.begin(), started.end()));
+  }
+
+  SECTION("versions are numbered per scope") {
+    auto x = Operand("x", OperandType::Var);
+    VersionCounters first, second;
+    {
+      VersionScope scope(first);
+      CHECK(x.newVersion().version() == 1);
+      CHECK(x.newVersion().version() == 2);
+      {
+        VersionScope inner(second);
+        CHECK(x.newVersion().version() == 1);
+      }
+      CHECK(x.newVersion().version() == 3);
+    }
+  }
+
+  SECTION("names and versions live in the table of their scope") {
+    NameTable names;
+    {
+      NameScope scope(names);
+      auto y = Operand("scoped_y", OperandType::Var);
+      auto version = y.newVersion();
+      CHECK(version.base() == y);
+      CHECK(version.version() == 1);
+      std::stringstream text;
+      text << version;
+      CHECK(text.str() == "scoped_y.1");
+      {
+        NameTable inner;
+        NameScope innerScope(inner);
+        CHECK(Operand("scoped_y", OperandType::Var).newVersion().version() ==
+              1);
+        CHECK(inner.versions() == 1);
+      }
+      CHECK(y.newVersion().version() == 2);
+    }
+    CHECK(names.symbols() == 1);
+    CHECK(names.versions() == 2);
+  }
+
+  SECTION("functions optimized concurrently match a serial run") {
+    std::string source;
+    for (int f = 0; f < 60; ++f) {
+      source += "def f" + std::to_string(f) + "(int n) : int { int x; x := n; ";
+      for (int k = 0; k <= f % 7; ++k) {
+        source += "if (x < " + std::to_string(k) + ") { x := x * 2 + n; } ";
+      }
+      source += "while (x < 50) { x := x + n + 1; } return x; } ";
+    }
+    source += "r := f5(3); output r;";
+    auto serial = compile(source, true);
+    auto parallel = compile(source, true);
+    PassManager serialPasses, parallelPasses;
+    serialPasses.add(PassManager::pipeline(2));
+    parallelPasses.add(PassManager::pipeline(2));
+    serialPasses.run(serial);
+    ThreadPool pool(4);
+    parallelPasses.run(parallel, &pool);
+
+    for (const auto& [name, cfg] : serial.functions) {
+      INFO(name);
+      std::stringstream expected, actual;
+      for (const auto& block : cfg->getBlocks()) {
+        for (const auto& instr : block.instructions()) {
+          expected << instr << "\n";
+        }
+      }
+      for (const auto& block : parallel.functions.at(name)->getBlocks()) {
+        for (const auto& instr : block.instructions()) {
+          actual << instr << "\n";
+        }
+      }
+      CHECK(actual.str() == expected.str());
+    }
+    for (std::size_t p = 0; p < serialPasses.statistics().size(); ++p) {
+      const auto& expected = serialPasses.statistics()[p];
+      const auto& actual = parallelPasses.statistics()[p];
+      CHECK(actual.runs == expected.runs);
+      CHECK(actual.changes == expected.changes);
+      CHECK(actual.instructionDelta == expected.instructionDelta);
+    }
+    CHECK(Interpreter(parallel).run() == Interpreter(serial).run());
+  }
+
+  SECTION("programs compile concurrently from source alike") {
+    auto optimize = [](const std::string& source) {
+      auto program = compile(source, true);
+      PassManager passes;
+      passes.add(PassManager::pipeline(2));
+      passes.run(program);
+      std::stringstream text;
+      for (const auto& [name, cfg] : program.functions) {
+        text << name << "\n";
+        for (const auto& block : cfg->getBlocks()) {
+          for (const auto& instr : block.instructions()) {
+            text << instr << "\n";
+          }
+        }
+      }
+      return text.str();
+    };
+    std::vector<std::string> sources;
+    for (const auto& path : testPrograms()) {
+      sources.push_back(readFile(path));
+    }
+    std::vector<std::string> concurrent(sources.size());
+    ThreadPool pool(4);
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+      pool.submit([&, i] { concurrent[i] = optimize(sources[i]); });
+    }
+    pool.wait();
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+      CHECK(concurrent[i] == optimize(sources[i]));
+    }
+  }
+}
+
+TEST_CASE("CFG analyses on 100k blocks", "[.][benchmark]") {
+  CFG cfg(manyLoops(17000));
+
+  BENCHMARK("edges") {
+    cfg.setBlocks(std::vector<BasicBlock>(cfg.getBlocks()));
+    return cfg.size();
+  };
+  BENCHMARK("reverse postorder") {
+    cfg.setBlocks(std::vector<BasicBlock>(cfg.getBlocks()));
+    return cfg.reversePostorder().size();
+  };
+  BENCHMARK("dominators and frontiers") {
+    cfg.setBlocks(std::vector<BasicBlock>(cfg.getBlocks()));
+    return cfg.dominanceFrontier(1).size();
+  };
+  BENCHMARK("natural loops") {
+    cfg.setBlocks(std::vector<BasicBlock>(cfg.getBlocks()));
+    return cfg.loops().size();
+  };
+}
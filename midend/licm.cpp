@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <vector>
+
+#include "midend/index_table.h"
+#include "midend/liveness.h"
+#include "midend/passes.h"
+
+// Loop-invariant code motion. An operation (binary or NOT) in a loop is
+// invariant when each operand is a constant, a variable assigned nowhere in
+// the loop, or the variable of an invariant operation that is its only
+// assignment in the loop. An invariant operation x <- a op b moves to the
+// end of the loop's preheader when
+//
+//   - it is the only assignment to x in the loop,
+//   - x is not live on entry to the header, so no use in the loop reads an
+//     x from before the loop or from the previous iteration, and
+//   - its block dominates every exit of the loop, or x is dead wherever the
+//     loop exits to.
+//
+// The last condition lets operations move out of the bodies of while loops,
+// which do not dominate the exit in the header: the operations cannot trap,
+// so running one on the path that skips the loop is harmless as long as
+// nothing reads the result there. Inner loops go first, so an operation
+// hoisted into an inner preheader can move on out of the enclosing loop.
+
+namespace cs160::midend {
+
+namespace {
+
+bool isInvariantCandidate(const Instruction& instr) {
+  return instr.isDefinition() && instr.getOpcode() != Opcode::CALL &&
+         instr.getOpcode() != Opcode::NIL;
+}
+
+class LoopInvariantCodeMotion {
+ public:
+  explicit LoopInvariantCodeMotion(CFG& cfg) : cfg(cfg) {}
+
+  bool run() {
+    bool changed = cfg.isolateEntry();
+    changed |= cfg.insertPreheaders();
+    const auto& loops = cfg.loops();
+    for (auto l = loops.size(); l-- > 0;) {
+      changed |= hoist(l);
+    }
+    return changed;
+  }
+
+ private:
+  bool contains(const NaturalLoop& loop, int block) const {
+    return std::binary_search(loop.blocks.begin(), loop.blocks.end(), block);
+  }
+
+  bool hoist(int l) {
+    const auto& loop = cfg.loops()[l];
+    int preheader = cfg.preheader(l);
+    if (preheader < 0) {
+      return false;
+    }
+
+    // assignments per variable inside the loop
+    IndexTable<Operand, OperandHash> vars;
+    std::vector<int> defs;
+    for (int b : loop.blocks) {
+      for (const auto& instr : cfg.getBlocks()[b].instructions()) {
+        if (instr.isDefinition()) {
+          std::size_t v = vars.insert(instr.getOperand0());
+          defs.resize(vars.size(), 0);
+          ++defs[v];
+        }
+      }
+    }
+
+    std::vector<int> exits;  // blocks of the loop with a successor outside
+    std::vector<int> targets;  // blocks outside the loop it exits to
+    for (int b : loop.blocks) {
+      for (int succ : cfg.successors(b)) {
+        if (!contains(loop, succ)) {
+          if (exits.empty() || exits.back() != b) {
+            exits.push_back(b);
+          }
+          targets.push_back(succ);
+        }
+      }
+    }
+
+    Liveness live(cfg);
+    std::vector<bool> invariant(vars.size(), false);
+    auto isInvariant = [&](const Operand& operand) {
+      if (operand.GetOperandType() != OperandType::Var) {
+        return true;
+      }
+      int v = vars.find(operand);
+      return v < 0 || invariant[v];
+    };
+    auto canMove = [&](int b, const Operand& var) {
+      if (live.isLiveIn(var, loop.header)) {
+        return false;
+      }
+      bool dominatesExits =
+          std::all_of(exits.begin(), exits.end(),
+                      [&](int exit) { return cfg.dominates(b, exit); });
+      return dominatesExits ||
+             std::none_of(targets.begin(), targets.end(), [&](int target) {
+               return live.isLiveIn(var, target);
+             });
+    };
+
+    // (block, instruction) of each hoisted operation, in the order found,
+    // which is an order where operands are computed before their uses
+    std::vector<std::vector<bool>> hoisted(loop.blocks.size());
+    std::vector<Instruction> moved;
+    bool found = true;
+    while (found) {
+      found = false;
+      for (int b : cfg.reversePostorder()) {
+        if (!contains(loop, b)) {
+          continue;
+        }
+        auto i = std::lower_bound(loop.blocks.begin(), loop.blocks.end(), b) -
+                 loop.blocks.begin();
+        const auto& instrs = cfg.getBlocks()[b].instructions();
+        hoisted[i].resize(instrs.size(), false);
+        for (std::size_t k = 0; k < instrs.size(); ++k) {
+          const auto& instr = instrs[k];
+          if (hoisted[i][k] || !isInvariantCandidate(instr)) {
+            continue;
+          }
+          int v = vars.find(instr.getOperand0());
+          bool operandsInvariant = true;
+          instr.forEachUse([&](const Operand& use) {
+            operandsInvariant &= isInvariant(use);
+          });
+          if (defs[v] != 1 || !operandsInvariant ||
+              !canMove(b, instr.getOperand0())) {
+            continue;
+          }
+          invariant[v] = true;
+          hoisted[i][k] = true;
+          moved.push_back(instr);
+          found = true;
+        }
+      }
+    }
+    if (moved.empty()) {
+      return false;
+    }
+
+    for (std::size_t i = 0; i < loop.blocks.size(); ++i) {
+      if (std::none_of(hoisted[i].begin(), hoisted[i].end(),
+                       [](bool h) { return h; })) {
+        continue;
+      }
+      const auto& instrs = cfg.getBlocks()[loop.blocks[i]].instructions();
+      std::vector<Instruction> kept;
+      for (std::size_t k = 0; k < instrs.size(); ++k) {
+        if (!hoisted[i][k]) {
+          kept.push_back(instrs[k]);
+        }
+      }
+      cfg.getBlock(loop.blocks[i]).setInstructions(std::move(kept));
+    }
+    auto instrs = cfg.getBlocks()[preheader].instructions();
+    auto last = instrs.end();
+    if (!instrs.empty() &&
+        (instrs.back().getOpcode() == Opcode::jump_conditional ||
+         instrs.back().endsFallthrough())) {
+      --last;
+    }
+    instrs.insert(last, moved.begin(), moved.end());
+    cfg.getBlock(preheader).setInstructions(std::move(instrs));
+    return true;
+  }
+
+  CFG& cfg;
+};
+
+}  // namespace
+
+bool hoistLoopInvariants(CFG& cfg) {
+  return LoopInvariantCodeMotion(cfg).run();
+}
+
+}  // namespace cs160::midend
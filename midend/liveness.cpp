@@ -0,0 +1,62 @@
+#include <utility>
+#include <vector>
+
+#include "midend/dataflow.h"
+#include "midend/liveness.h"
+
+namespace cs160::midend {
+
+// gen is the set of variables read before any write in the block, kill the
+// set of variables written; both come from one backward pass per block.
+Liveness::Liveness(const CFG& cfg) {
+  for (const auto& block : cfg.getBlocks()) {
+    for (const auto& instr : block.instructions()) {
+      instr.forEachUse([&](const Operand& use) {
+        if (use.GetOperandType() == OperandType::Var) {
+          vars.insert(use);
+        }
+      });
+      if (instr.isDefinition()) {
+        vars.insert(instr.getOperand0());
+      }
+    }
+  }
+
+  std::vector<BitVectorPair> genkill(
+      cfg.size(), {BitVector(vars.size()), BitVector(vars.size())});
+  for (std::size_t b = 0; b < cfg.size(); ++b) {
+    auto& [gen, kill] = genkill[b];
+    const auto& instrs = cfg.getBlocks()[b].instructions();
+    for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+      if (it->isDefinition()) {
+        int def = vars.find(it->getOperand0());
+        gen.reset(def);
+        kill.set(def);
+      }
+      it->forEachUse([&](const Operand& use) {
+        if (use.GetOperandType() == OperandType::Var) {
+          gen.set(vars.find(use));
+        }
+      });
+    }
+  }
+
+  DataflowAnalysis<BitVector, Backward, UnionMeet, GenKillTransfer<BitVector>>
+      analysis(cfg, BitVector(vars.size()), BitVector(vars.size()),
+               {genkill});
+  analysis.run();
+  sets = std::move(analysis.results());
+}
+
+void Liveness::transfer(const Instruction& instr, BitVector& live) const {
+  if (instr.isDefinition()) {
+    live.reset(vars.find(instr.getOperand0()));
+  }
+  instr.forEachUse([&](const Operand& use) {
+    if (use.GetOperandType() == OperandType::Var) {
+      live.set(vars.find(use));
+    }
+  });
+}
+
+}  // namespace cs160::midend
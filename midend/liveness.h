@@ -0,0 +1,37 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "midend/bitvector.h"
+#include "midend/index_table.h"
+#include "midend/ir.h"
+
+namespace cs160::midend {
+
+// Live variables at block boundaries, solved backwards with the generic
+// DataflowAnalysis engine. Variables are numbered densely in the order they
+// first appear. Phis are not modeled, so this is for code outside SSA form.
+class Liveness {
+ public:
+  explicit Liveness(const CFG& cfg);
+
+  const IndexTable<Operand, OperandHash>& variables() const { return vars; }
+  const BitVector& liveIn(int block) const { return sets[block].first; }
+  const BitVector& liveOut(int block) const { return sets[block].second; }
+  bool isLiveIn(const Operand& var, int block) const {
+    int v = vars.find(var);
+    return v >= 0 && liveIn(block).test(v);
+  }
+
+  // Turns the set of variables live after instr into the set live before
+  // it. Walking a block backwards from liveOut with this recovers liveness
+  // at every instruction.
+  void transfer(const Instruction& instr, BitVector& live) const;
+
+ private:
+  IndexTable<Operand, OperandHash> vars;
+  std::vector<BitVectorPair> sets;
+};
+
+}  // namespace cs160::midend
@@ -0,0 +1,166 @@
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "midend/index_table.h"
+#include "midend/passes.h"
+
+namespace cs160::midend {
+
+namespace {
+
+// Value numbers of one basic block. Every operand (variable or constant)
+// seen in the block gets a slot holding its current value number; every
+// value number remembers a home, the first operand that held it, which
+// stays usable for as long as that variable is not reassigned.
+class ValueTable {
+ public:
+  void clear() {
+    operands.clear();
+    operandValue.clear();
+    exprs.clear();
+    exprValue.clear();
+    home.clear();
+    isConstant.clear();
+    constant.clear();
+  }
+
+  int valueOf(const Operand& operand) {
+    std::size_t slot = operands.insert(operand);
+    if (slot == operandValue.size()) {
+      int value = fresh();
+      operandValue.push_back(value);
+      home[value] = operand;
+      if (operand.GetOperandType() == OperandType::Int) {
+        isConstant[value] = true;
+        constant[value] = operand.GetConstant();
+      }
+    }
+    return operandValue[slot];
+  }
+
+  void assign(const Operand& var, int value) {
+    valueOf(var);
+    operandValue[operands.find(var)] = value;
+    if (!homeOf(value)) {
+      home[value] = var;
+    }
+  }
+
+  // An operand currently holding value, if any
+  std::optional<Operand> homeOf(int value) const {
+    auto operand = home[value];
+    if (operand.GetOperandType() == OperandType::Int) {
+      return operand;
+    }
+    int slot = operands.find(operand);
+    if (slot >= 0 && operandValue[slot] == value) {
+      return operand;
+    }
+    return std::nullopt;
+  }
+
+  std::optional<int> constantOf(int value) const {
+    if (isConstant[value]) {
+      return constant[value];
+    }
+    return std::nullopt;
+  }
+
+  // Value number of op applied to the given values, and whether it was
+  // already known
+  std::pair<int, bool> valueOf(Opcode op, int lhs, int rhs) {
+    std::size_t id = exprs.insert(ValueExpr(op, lhs, rhs));
+    if (id < exprValue.size()) {
+      return {exprValue[id], true};
+    }
+    exprValue.push_back(fresh());
+    return {exprValue.back(), false};
+  }
+
+  int fresh() {
+    home.push_back(Operand());
+    isConstant.push_back(false);
+    constant.push_back(0);
+    return home.size() - 1;
+  }
+
+ private:
+  IndexTable<Operand, OperandHash> operands;
+  std::vector<int> operandValue;
+  IndexTable<ValueExpr, ValueExprHash> exprs;
+  std::vector<int> exprValue;
+  std::vector<Operand> home;
+  std::vector<bool> isConstant;
+  std::vector<int> constant;
+};
+
+bool numberBlock(BasicBlock& block, ValueTable& values) {
+  bool changed = false;
+  values.clear();
+  std::vector<Instruction> instrs = block.instructions();
+
+  for (auto& instr : instrs) {
+    // reads see the canonical holder of their value
+    instr.forEachUse([&](Operand& use) {
+      auto home = values.homeOf(values.valueOf(use));
+      if (home && *home != use) {
+        use = *home;
+        changed = true;
+      }
+    });
+
+    if (!instr.isDefinition()) {
+      continue;
+    }
+    auto lhs = instr.getOperand0();
+    auto op = instr.getOpcode();
+    if (op == Opcode::CALL) {
+      values.assign(lhs, values.fresh());
+      continue;
+    }
+    if (op == Opcode::NIL) {  // copy
+      values.assign(lhs, values.valueOf(instr.getOperand1()));
+      continue;
+    }
+
+    int a = values.valueOf(instr.getOperand1());
+    int b = instr.isBinary() ? values.valueOf(instr.getOperand2()) : -1;
+    auto ca = values.constantOf(a);
+    auto cb = instr.isBinary() ? values.constantOf(b) : std::optional<int>(0);
+    if (ca && cb) {
+      int result = EvaluateOpcode(op, *ca, *cb);
+      instr = Instruction(lhs, Operand(result));
+      values.assign(lhs, values.valueOf(Operand(result)));
+      changed = true;
+      continue;
+    }
+
+    auto [value, known] = values.valueOf(op, a, b);
+    auto home = known ? values.homeOf(value) : std::nullopt;
+    if (home) {
+      instr = Instruction(lhs, *home);
+      changed = true;
+    }
+    values.assign(lhs, value);
+  }
+
+  if (changed) {
+    block.setInstructions(std::move(instrs));
+  }
+  return changed;
+}
+
+}  // namespace
+
+bool localValueNumbering(CFG& cfg) {
+  bool changed = false;
+  ValueTable values;
+  for (std::size_t b = 0; b < cfg.size(); ++b) {
+    changed |= numberBlock(cfg.getBlock(b), values);
+  }
+  changed |= removeUnusedTemporaries(cfg);
+  return changed;
+}
+
+}  // namespace cs160::midend
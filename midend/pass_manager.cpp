@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+#include "midend/pass_manager.h"
+#include "midend/passes.h"
+
+namespace cs160::midend {
+
+namespace {
+
+// Callees of at most this many instructions are inlined
+constexpr std::size_t inlineThreshold = 40;
+
+// Copy propagation leaves copies dead and deleting them can leave
+// temporaries with a single use to coalesce, so the two alternate until
+// neither changes anything
+bool cleanUp(CFG& cfg, FunctionAnalyses& analyses) {
+  bool changed = false;
+  while (true) {
+    if (!propagateCopies(cfg) &&
+        !eliminateDeadCode(cfg, analyses.liveness())) {
+      return changed;
+    }
+    analyses.invalidate();
+    changed = true;
+  }
+}
+
+// Adapts a pass of passes.h that needs no analyses
+FunctionPass plain(bool (*pass)(CFG&)) {
+  return [pass](CFG& cfg, FunctionAnalyses&) { return pass(cfg); };
+}
+
+}  // namespace
+
+const Liveness& FunctionAnalyses::liveness() {
+  if (!live) {
+    live.emplace(cfg);
+  }
+  return *live;
+}
+
+void FunctionAnalyses::solveAvailableExpressions() {
+  if (!availableExpressionsSolved) {
+    cfg.computeAvailExprs();
+    availableExpressionsSolved = true;
+  }
+}
+
+void FunctionAnalyses::invalidate() {
+  live.reset();
+  availableExpressionsSolved = false;
+}
+
+PassManager::PassManager() {
+  registerPass("simplify", plain(simplifyControlFlow));
+  registerPass("lvn", plain(localValueNumbering));
+  registerPass("gcse", [](CFG& cfg, FunctionAnalyses& analyses) {
+    analyses.solveAvailableExpressions();
+    bool replaced = cfg.computeGCSE();
+    // the _optN copies go in even when nothing is replaced
+    analyses.invalidate();
+    return replaced;
+  });
+  registerPass("gvn", plain(globalValueNumbering));
+  registerPass("lcm", plain(lazyCodeMotion));
+  registerPass("sccp", plain(sparseConditionalConstantPropagation));
+  registerPass("copyprop", plain(propagateCopies));
+  registerPass("dce", [](CFG& cfg, FunctionAnalyses& analyses) {
+    return eliminateDeadCode(cfg, analyses.liveness());
+  });
+  registerPass("rmtemps", plain(removeUnusedTemporaries));
+  registerPass("cleanup", cleanUp);
+  registerPass("licm", plain(hoistLoopInvariants));
+  registerPass("strength", plain(reduceStrength));
+  registerModulePass("tailrec", eliminateTailRecursion);
+  registerModulePass("inline", [](Module& module) {
+    return inlineCalls(module, inlineThreshold, [](CFG& cfg) {
+      FunctionAnalyses analyses(cfg);
+      cleanUp(cfg, analyses);
+      simplifyControlFlow(cfg);
+    });
+  });
+}
+
+void PassManager::registerPass(const std::string& name, FunctionPass pass) {
+  modulePasses.erase(name);
+  functionPasses[name] = std::move(pass);
+}
+
+void PassManager::registerModulePass(const std::string& name,
+                                     ModulePass pass) {
+  functionPasses.erase(name);
+  modulePasses[name] = std::move(pass);
+}
+
+std::vector<std::string> PassManager::registeredPasses() const {
+  std::vector<std::string> names;
+  for (const auto& [name, pass] : functionPasses) {
+    names.push_back(name);
+  }
+  for (const auto& [name, pass] : modulePasses) {
+    names.push_back(name);
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+std::string PassManager::pipeline(int level) {
+  if (level <= 0) {
+    return "";
+  }
+  if (level == 1) {
+    return "simplify,lvn,gcse,cleanup,simplify";
+  }
+  return "tailrec,inline,simplify,lvn,sccp,gvn,lcm,cleanup,licm,strength,"
+         "cleanup,simplify";
+}
+
+void PassManager::add(const std::string& names) {
+  std::vector<std::string> added;
+  std::stringstream list(names);
+  std::string name;
+  while (std::getline(list, name, ',')) {
+    if (name.empty()) {
+      continue;
+    }
+    if (!functionPasses.count(name) && !modulePasses.count(name)) {
+      throw PassError("unknown pass '" + name + "'");
+    }
+    added.push_back(name);
+  }
+  for (auto& name : added) {
+    stats.push_back({name});
+    pipelinePasses.push_back(std::move(name));
+  }
+}
+
+bool PassManager::runFunctionPasses(CFG& cfg, std::size_t first,
+                                    std::size_t last,
+                                    std::vector<PassStatistics>& into) {
+  VersionScope scope(cfg.versionCounters());
+  FunctionAnalyses analyses(cfg);
+  bool changed = false;
+  for (auto p = first; p < last; ++p) {
+    if (modulePasses.count(pipelinePasses[p])) {
+      continue;
+    }
+    auto& stat = into[p];
+    auto before = cfg.instructionCount();
+    auto start = std::chrono::steady_clock::now();
+    bool passChanged = functionPasses.at(pipelinePasses[p])(cfg, analyses);
+    stat.seconds += std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    ++stat.runs;
+    stat.instructionDelta += static_cast<long>(cfg.instructionCount()) -
+                             static_cast<long>(before);
+    if (passChanged) {
+      ++stat.changes;
+      analyses.invalidate();
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool PassManager::runFunctionPasses(Module& module, std::size_t first,
+                                    std::size_t last, ThreadPool* pool) {
+  if (!pool || pool->size() < 2 || module.functions.size() < 2) {
+    bool changed = false;
+    for (auto& [name, cfg] : module.functions) {
+      changed |= runFunctionPasses(*cfg, first, last, stats);
+    }
+    return changed;
+  }
+
+  std::vector<CFG*> functions;
+  for (auto& [name, cfg] : module.functions) {
+    functions.push_back(cfg.get());
+  }
+  // the largest functions go first, so none is left to start last
+  std::vector<std::size_t> order(functions.size());
+  for (std::size_t f = 0; f < order.size(); ++f) {
+    order[f] = f;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](auto f, auto g) {
+    return functions[f]->instructionCount() >
+           functions[g]->instructionCount();
+  });
+  std::vector<std::vector<PassStatistics>> local(
+      functions.size(), std::vector<PassStatistics>(stats.size()));
+  std::vector<char> changed(functions.size(), false);
+  // the workers name new operands in the table of the submitting thread
+  auto& names = NameTable::current();
+  for (auto f : order) {
+    pool->submit([this, f, first, last, &functions, &local, &changed,
+                  &names] {
+      NameScope scope(names);
+      changed[f] = runFunctionPasses(*functions[f], first, last, local[f]);
+    });
+  }
+  pool->wait();
+
+  // summed in function order, like a serial run would
+  for (const auto& function : local) {
+    for (auto p = first; p < last; ++p) {
+      stats[p].runs += function[p].runs;
+      stats[p].changes += function[p].changes;
+      stats[p].seconds += function[p].seconds;
+      stats[p].instructionDelta += function[p].instructionDelta;
+    }
+  }
+  return std::find(changed.begin(), changed.end(), true) != changed.end();
+}
+
+bool PassManager::run(Module& module, ThreadPool* pool) {
+  bool changed = false;
+  std::size_t p = 0;
+  while (p < pipelinePasses.size()) {
+    auto modulePass = modulePasses.find(pipelinePasses[p]);
+    if (modulePass != modulePasses.end()) {
+      auto& stat = stats[p];
+      auto before = module.instructionCount();
+      auto start = std::chrono::steady_clock::now();
+      bool passChanged = modulePass->second(module);
+      stat.seconds += std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+      ++stat.runs;
+      stat.changes += passChanged;
+      stat.instructionDelta += static_cast<long>(module.instructionCount()) -
+                               static_cast<long>(before);
+      changed |= passChanged;
+      ++p;
+      continue;
+    }
+    auto last = p;
+    while (last < pipelinePasses.size() &&
+           !modulePasses.count(pipelinePasses[last])) {
+      ++last;
+    }
+    changed |= runFunctionPasses(module, p, last, pool);
+    p = last;
+  }
+  return changed;
+}
+
+bool PassManager::run(CFG& cfg) {
+  return runFunctionPasses(cfg, 0, pipelinePasses.size(), stats);
+}
+
+void PassManager::printStatistics(std::ostream& out) const {
+  auto flags = out.flags();
+  auto precision = out.precision();
+  out << std::fixed << std::setprecision(3);
+  out << std::left << std::setw(12) << "pass" << std::right << std::setw(6)
+      << "runs" << std::setw(9) << "changed" << std::setw(12) << "time (ms)"
+      << std::setw(14) << "instructions" << std::endl;
+  double total = 0;
+  long delta = 0;
+  for (const auto& stat : stats) {
+    out << std::left << std::setw(12) << stat.name << std::right
+        << std::setw(6) << stat.runs << std::setw(9) << stat.changes
+        << std::setw(12) << stat.seconds * 1000 << std::setw(14)
+        << std::showpos << stat.instructionDelta << std::noshowpos
+        << std::endl;
+    total += stat.seconds;
+    delta += stat.instructionDelta;
+  }
+  out << std::left << std::setw(27) << "total" << std::right << std::setw(12)
+      << total * 1000 << std::setw(14) << std::showpos << delta
+      << std::noshowpos << std::endl;
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}  // namespace cs160::midend
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "midend/ir.h"
+#include "midend/liveness.h"
+#include "midend/thread_pool.h"
+
+namespace cs160::midend {
+
+// Thrown for pipelines naming passes that are not registered
+struct PassError : public std::runtime_error {
+  explicit PassError(const std::string& message) : runtime_error(message) {}
+};
+
+// The dataflow analyses of one function that passes can share. Each is
+// solved on first use and kept until invalidate(), which the pass manager
+// calls after every pass that changed the function. The block orderings,
+// dominators and loops are cached by the CFG itself, which drops them
+// whenever its blocks are replaced.
+class FunctionAnalyses {
+ public:
+  explicit FunctionAnalyses(CFG& cfg) : cfg(cfg) {}
+
+  const Liveness& liveness();
+  // Solves available expressions into the CFG (see
+  // CFG::getAvailableExpressions) unless they are solved already
+  void solveAvailableExpressions();
+
+  void invalidate();
+
+ private:
+  CFG& cfg;
+  std::optional<Liveness> live;
+  bool availableExpressionsSolved = false;
+};
+
+using FunctionPass = std::function<bool(CFG&, FunctionAnalyses&)>;
+using ModulePass = std::function<bool(Module&)>;
+
+// What one entry of the pipeline did, summed over the functions it ran on
+struct PassStatistics {
+  std::string name;
+  int runs = 0;
+  // Runs that changed something
+  int changes = 0;
+  double seconds = 0;
+  // Instructions after minus instructions before, labels excluded
+  long instructionDelta = 0;
+};
+
+// Runs a pipeline of passes looked up by name. Function passes see one
+// function at a time and module passes the whole module; a run of
+// consecutive function passes goes through each function in turn, so the
+// analyses cached for a function carry over from one pass to the next.
+// Functions are independent there, so given a thread pool they go through
+// such a run concurrently, largest first. Each function numbers its SSA
+// versions in its own VersionScope, which keeps the result the same as a
+// serial run.
+class PassManager {
+ public:
+  // Registers the passes of passes.h, under the names listed by
+  // registeredPasses()
+  PassManager();
+
+  void registerPass(const std::string& name, FunctionPass pass);
+  void registerModulePass(const std::string& name, ModulePass pass);
+  // Names of all registered passes, sorted
+  std::vector<std::string> registeredPasses() const;
+
+  // The pipeline for an optimization level from 0 to 2, comma separated
+  static std::string pipeline(int level);
+  // Appends the comma separated passes of names to the pipeline. Throws
+  // PassError for an unknown name, leaving the pipeline as it was.
+  void add(const std::string& names);
+  const std::vector<std::string>& passes() const { return pipelinePasses; }
+
+  // Runs the pipeline over every function of module, on pool if given.
+  // Returns whether any pass changed anything.
+  bool run(Module& module, ThreadPool* pool = nullptr);
+  // Runs the pipeline over a single function; module passes are skipped
+  bool run(CFG& cfg);
+
+  // One entry per pipeline position, in order, accumulated over all runs
+  const std::vector<PassStatistics>& statistics() const { return stats; }
+  void printStatistics(std::ostream& out) const;
+
+ private:
+  // Runs the function passes at positions [first, last) over cfg,
+  // skipping module passes, and adds to the statistics in into
+  bool runFunctionPasses(CFG& cfg, std::size_t first, std::size_t last,
+                         std::vector<PassStatistics>& into);
+  // Runs positions [first, last), all function passes, over every function
+  bool runFunctionPasses(Module& module, std::size_t first, std::size_t last,
+                         ThreadPool* pool);
+
+  std::map<std::string, FunctionPass> functionPasses;
+  std::map<std::string, ModulePass> modulePasses;
+  std::vector<std::string> pipelinePasses;
+  std::vector<PassStatistics> stats;
+};
+
+}  // namespace cs160::midend
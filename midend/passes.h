@@ -0,0 +1,112 @@
+#pragma once
+
+#include <functional>
+
+#include "midend/ir.h"
+
+// Optimization passes over the TAC CFG of a single function. Each pass
+// rewrites the CFG in place and returns whether it changed anything.
+
+namespace cs160::midend {
+
+class Liveness;
+
+// Deletes the definitions (other than calls) of temporaries that are never
+// read, including temporaries only read by other deleted definitions
+bool removeUnusedTemporaries(CFG& cfg);
+
+// Cleans up the shape of the CFG: jumps to blocks that only jump on (or
+// only hold a label) go straight to the final target, jumps to the next
+// block are dropped, unreachable blocks are deleted and a block falling
+// through to a block with no other predecessor absorbs it. Blocks are
+// renumbered in order. Needs the function out of SSA form.
+bool simplifyControlFlow(CFG& cfg);
+
+// Deletes the instructions (other than calls) that assign a variable which
+// is dead afterwards: never read before being assigned again or the
+// function returning. Needs the function out of SSA form.
+bool eliminateDeadCode(CFG& cfg);
+// The same, starting from liveness already solved for the current code
+bool eliminateDeadCode(CFG& cfg, const Liveness& live);
+
+// Value numbers the instructions of each basic block: redundant binary and
+// NOT computations become copies of an earlier result, operations on known
+// constants are folded, uses are rewritten to the oldest variable (or the
+// constant) holding the same value, and compiler temporaries left without
+// any use are deleted.
+bool localValueNumbering(CFG& cfg);
+
+// Rewrites the function into pruned SSA form: every definition gets a fresh
+// version of its variable and phis are placed where versions meet, only
+// for variables live there. Uses reached by no definition keep the plain
+// name, which stands for the value on entry. If the entry block is a loop
+// header, an empty block is put in front of it first.
+bool constructSSA(CFG& cfg);
+
+// Takes the function out of SSA form by replacing the phis with copies on
+// the incoming edges, splitting critical edges where needed
+bool destructSSA(CFG& cfg);
+
+// Removes computations that are fully redundant across blocks: in SSA form,
+// an operation whose value (up to commutativity, copies and constants) is
+// already held by a variable defined in a dominating position becomes a
+// copy of that variable, and uses read the dominating variable directly.
+// Phis merging a single value are dropped. The function is left out of SSA
+// form again.
+bool globalValueNumbering(CFG& cfg);
+
+// Partial redundancy elimination by lazy code motion: computations of a
+// binary expression are moved to the latest points where they still make
+// every later computation of it redundant, so computations redundant on
+// some paths only (including loop invariants already computed ahead of the
+// loop on some path) are removed without lengthening any path. Critical
+// edges are split.
+bool lazyCodeMotion(CFG& cfg);
+
+// Sparse conditional constant propagation: on SSA form, finds the variables
+// holding one constant on every path that can actually execute, assuming
+// branches on constants only go one way. Their uses become the constant,
+// operations on constants are folded, constant branches become jumps or
+// fall through, and blocks left unreachable are deleted. The function is
+// left out of SSA form again.
+bool sparseConditionalConstantPropagation(CFG& cfg);
+
+// Global copy propagation: uses of x read y instead wherever a copy x <- y
+// (y a variable or a constant) reaches on every path with neither side
+// reassigned. Temporaries assigned once and copied straight into a
+// variable are coalesced with it (t <- a + b; x <- t becomes x <- a + b),
+// and temporaries left unused are deleted. Runs until nothing changes.
+bool propagateCopies(CFG& cfg);
+
+// Loop-invariant code motion: gives every loop a preheader and moves the
+// operations whose operands do not change in the loop into it, innermost
+// loops first. An operation only moves if its variable is assigned nowhere
+// else in the loop and the move cannot change what any read of it sees,
+// including on the path that skips a while loop. Needs the function out of
+// SSA form.
+bool hoistLoopInvariants(CFG& cfg);
+
+// Strength reduction: in each loop, products of a basic induction variable
+// (one stepped by a constant once per iteration) and a loop invariant are
+// replaced by a new variable advanced by additions. The loop's exit test
+// is rewritten onto that variable when this cannot overflow, and the
+// induction variable itself is deleted if nothing else needs it. Expects
+// copy propagation to have run, and the function out of SSA form.
+bool reduceStrength(CFG& cfg);
+
+// Inlines calls to functions of at most threshold instructions (twice that
+// for calls inside loops) into their callers, going through the call graph
+// callees first. Functions that can reach themselves through calls are
+// never inlined. Each function that grew is handed to reoptimize, if given,
+// before it is weighed as a callee in turn.
+bool inlineCalls(Module& module, std::size_t threshold,
+                 const std::function<void(CFG&)>& reoptimize = nullptr);
+
+// Tail-recursion elimination: self-calls whose result is returned, either
+// as it is or added to or multiplied by a value known at the call, become
+// jumps back to the start of the function, with an accumulator carrying
+// the additions or multiplications still owed. Needs the functions out of
+// SSA form.
+bool eliminateTailRecursion(Module& module);
+
+}  // namespace cs160::midend
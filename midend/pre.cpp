@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "midend/dataflow.h"
+#include "midend/passes.h"
+
+// Lazy code motion, in the block-level formulation of Cooper and Torczon
+// (Engineering a Compiler, 10.3), over the binary expressions of a function:
+//
+//   AvailOut(i)    = DEExpr(i) | (AvailIn(i) - ExprKill(i)), meet is &
+//   AntIn(i)       = UEExpr(i) | (AntOut(i) - ExprKill(i)), meet is &
+//   Earliest(i, j) = AntIn(j) & ~AvailOut(i) & (ExprKill(i) | ~AntOut(i))
+//                    (just AntIn(j) & ~AvailOut(i) when i is the entry)
+//   LaterIn(j)     = & over predecessors i of Later(i, j), empty at entry
+//   Later(i, j)    = Earliest(i, j) | (LaterIn(i) - UEExpr(i))
+//   Insert(i, j)   = Later(i, j) - LaterIn(j)
+//   Delete(k)      = UEExpr(k) - LaterIn(k), for k other than the entry
+//
+// Each expression e that is moved gets a temporary _preN. Computations of e
+// are inserted on the edges in Insert as _preN <- e, the upward exposed
+// computation in a Delete block becomes x <- _preN, and the downward
+// exposed computations that may feed those now go through _preN too.
+// Critical edges are split first so every edge has a place for insertions.
+// The copies this leaves behind are for copy propagation to clean up.
+
+namespace cs160::midend {
+
+namespace {
+
+class LazyCodeMotion {
+ public:
+  explicit LazyCodeMotion(CFG& cfg) : cfg(cfg) {}
+
+  bool run() {
+    bool changed = cfg.isolateEntry();
+    changed |= cfg.splitCriticalEdges();
+    collectExpressions();
+    if (exprs.empty()) {
+      return changed;
+    }
+    computeLocalSets();
+    solve();
+    return rewrite() || changed;
+  }
+
+ private:
+  void collectExpressions() {
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        if (!instr.isBinary()) {
+          continue;
+        }
+        auto key = ExprKey::of(instr);
+        auto size = exprs.size();
+        int e = exprs.insert(key);
+        if (exprs.size() == size) {
+          continue;
+        }
+        for (auto operand : {key.lhs, key.rhs}) {
+          if (operand.GetOperandType() != OperandType::Var) {
+            continue;
+          }
+          std::size_t v = vars.insert(operand);
+          exprsUsingVar.resize(vars.size());
+          if (exprsUsingVar[v].empty() || exprsUsingVar[v].back() != e) {
+            exprsUsingVar[v].push_back(e);
+          }
+        }
+      }
+    }
+  }
+
+  // stamp[v] == mark iff v was seen defined in the current scan
+  bool defined(const Operand& operand, const std::vector<int>& stamp,
+               int mark) const {
+    int v = vars.find(operand);
+    return v >= 0 && stamp[v] == mark;
+  }
+
+  void computeLocalSets() {
+    auto n = cfg.size();
+    upwardExposed.assign(n, BitVector(exprs.size()));
+    downwardExposed.assign(n, BitVector(exprs.size()));
+    killed.assign(n, BitVector(exprs.size()));
+    std::vector<int> definedBefore(vars.size(), -1);
+    std::vector<int> definedAfter(vars.size(), -1);
+    seen.assign(exprs.size(), -1);
+
+    for (std::size_t b = 0; b < n; ++b) {
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      for (const auto& instr : instrs) {
+        if (instr.isBinary()) {
+          auto key = ExprKey::of(instr);
+          if (!defined(key.lhs, definedBefore, b) &&
+              !defined(key.rhs, definedBefore, b)) {
+            upwardExposed[b].set(exprs.find(key));
+          }
+        }
+        if (instr.isDefinition()) {
+          int v = vars.find(instr.getOperand0());
+          if (v >= 0) {
+            definedBefore[v] = b;
+            for (int e : exprsUsingVar[v]) {
+              killed[b].set(e);
+            }
+          }
+        }
+      }
+
+      forEachDownwardExposed(b, definedAfter, [&](int e, std::size_t) {
+        downwardExposed[b].set(e);
+      });
+    }
+  }
+
+  // Calls f(expression, index) for the last computation of each expression
+  // in block b that no later instruction of the block invalidates
+  template <typename F>
+  void forEachDownwardExposed(int b, std::vector<int>& definedAfter, F f) {
+    const auto& instrs = cfg.getBlocks()[b].instructions();
+    ++scan;
+    for (int i = instrs.size() - 1; i >= 0; --i) {
+      const auto& instr = instrs[i];
+      if (instr.isBinary()) {
+        auto key = ExprKey::of(instr);
+        int e = exprs.find(key);
+        if (seen[e] != scan && !defined(key.lhs, definedAfter, scan) &&
+            !defined(key.rhs, definedAfter, scan) &&
+            !key.uses(instr.getOperand0())) {
+          seen[e] = scan;
+          f(e, i);
+        }
+      }
+      if (instr.isDefinition()) {
+        int v = vars.find(instr.getOperand0());
+        if (v >= 0) {
+          definedAfter[v] = scan;
+        }
+      }
+    }
+  }
+
+  BitVector earliest(int i, int j) const {
+    BitVector result = antIn[j];
+    result.subtract(availOut[i]);
+    if (i != 0) {
+      BitVector keepsGoing = antOut[i];  // ~(ExprKill(i) | ~AntOut(i))
+      keepsGoing.subtract(killed[i]);
+      result.subtract(keepsGoing);
+    }
+    return result;
+  }
+
+  BitVector later(int i, int j) const {
+    BitVector result = laterIn[i];
+    result.subtract(upwardExposed[i]);
+    result.unionWith(earliest(i, j));
+    return result;
+  }
+
+  void solve() {
+    auto n = cfg.size();
+    auto none = BitVector(exprs.size());
+    auto all = BitVector(exprs.size(), true);
+
+    std::vector<BitVectorPair> availSets(n), antSets(n);
+    for (std::size_t b = 0; b < n; ++b) {
+      availSets[b] = {downwardExposed[b], killed[b]};
+      antSets[b] = {upwardExposed[b], killed[b]};
+    }
+    DataflowAnalysis<BitVector, Forward, IntersectMeet,
+                     GenKillTransfer<BitVector>>
+        avail(cfg, none, all, {availSets});
+    avail.run();
+    DataflowAnalysis<BitVector, Backward, IntersectMeet,
+                     GenKillTransfer<BitVector>>
+        ant(cfg, none, all, {antSets});
+    ant.run();
+    for (std::size_t b = 0; b < n; ++b) {
+      availOut.push_back(avail.out(b));
+      antIn.push_back(ant.in(b));
+      antOut.push_back(ant.out(b));
+    }
+
+    laterIn.assign(n, all);
+    laterIn[0] = none;
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (int j : cfg.reversePostorder()) {
+        if (j == 0) {
+          continue;
+        }
+        BitVector in = all;
+        for (int i : cfg.predecessors(j)) {
+          in.intersectWith(later(i, j));
+        }
+        if (!(in == laterIn[j])) {
+          laterIn[j] = std::move(in);
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // Splices the computations tmp(e) <- e for the expressions in set into
+  // instrs before position
+  void insertComputations(std::vector<Instruction>& instrs,
+                          std::size_t position, const BitVector& set) {
+    std::vector<Instruction> computations;
+    set.forEachSetBit([&](std::size_t e) {
+      const auto& key = exprs.key(e);
+      computations.push_back(Instruction(tmp[e], key.op, key.lhs, key.rhs));
+    });
+    instrs.insert(instrs.begin() + position, computations.begin(),
+                  computations.end());
+  }
+
+  bool rewrite() {
+    auto n = cfg.size();
+    std::vector<BitVector> deleted(n, BitVector(exprs.size()));
+    BitVector moved(exprs.size());
+    for (std::size_t k = 1; k < n; ++k) {
+      deleted[k] = upwardExposed[k];
+      deleted[k].subtract(laterIn[k]);
+      moved.unionWith(deleted[k]);
+    }
+    if (!moved.any()) {
+      return false;
+    }
+
+    uint32_t next = 0;
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        if (instr.isDefinition() &&
+            instr.getOperand0().GetNameKind() == NameKind::Pre) {
+          next = std::max(next, instr.getOperand0().GetId() + 1);
+        }
+      }
+    }
+    tmp.assign(exprs.size(), Operand());
+    moved.forEachSetBit([&](std::size_t e) {
+      tmp[e] = Operand(NameKind::Pre, next++, OperandType::Var);
+    });
+
+    // computations for the edges, at the end of the source if it has only
+    // that successor or else at the top of the target (edges are not
+    // critical, so then the source is the target's only predecessor)
+    std::vector<BitVector> atEnd(n, BitVector(exprs.size()));
+    std::vector<BitVector> atStart(n, BitVector(exprs.size()));
+    for (std::size_t j = 1; j < n; ++j) {
+      for (int i : cfg.predecessors(j)) {
+        BitVector insert = later(i, j);
+        insert.subtract(laterIn[j]);
+        insert.intersectWith(moved);
+        (cfg.successors(i).size() == 1 ? atEnd[i] : atStart[j])
+            .unionWith(insert);
+      }
+    }
+
+    std::vector<int> definedAfter(vars.size(), -1);
+    for (std::size_t b = 0; b < n; ++b) {
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      std::vector<bool> saves(instrs.size(), false);
+      forEachDownwardExposed(b, definedAfter, [&](int e, std::size_t i) {
+        saves[i] = moved.test(e);
+      });
+      std::vector<Instruction> out;
+      out.reserve(instrs.size());
+      BitVector pending = deleted[b];  // first computation not seen yet
+      for (std::size_t i = 0; i < instrs.size(); ++i) {
+        const auto& instr = instrs[i];
+        if (!instr.isBinary()) {
+          out.push_back(instr);
+          continue;
+        }
+        int e = exprs.find(ExprKey::of(instr));
+        if (pending.test(e)) {
+          // the upward exposed computation is the first one in the block
+          pending.reset(e);
+          out.push_back(Instruction(instr.getOperand0(), tmp[e]));
+        } else if (saves[i]) {
+          out.push_back(Instruction(tmp[e], instr.getOpcode(),
+                                    instr.getOperand1(), instr.getOperand2()));
+          out.push_back(Instruction(instr.getOperand0(), tmp[e]));
+        } else {
+          out.push_back(instr);
+        }
+      }
+
+      std::size_t first = !out.empty() && out.front().isLabel() ? 1 : 0;
+      insertComputations(out, first, atStart[b]);
+      std::size_t last = out.size();
+      if (last > 0 && (out.back().getOpcode() == Opcode::jump_conditional ||
+                       out.back().endsFallthrough())) {
+        --last;
+      }
+      insertComputations(out, last, atEnd[b]);
+      cfg.getBlock(b).setInstructions(std::move(out));
+    }
+    return true;
+  }
+
+  CFG& cfg;
+  ExprTable exprs;
+  IndexTable<Operand, OperandHash> vars;
+  std::vector<std::vector<int>> exprsUsingVar;
+  std::vector<BitVector> upwardExposed;
+  std::vector<BitVector> downwardExposed;
+  std::vector<BitVector> killed;
+  // scan numbers, so the marks of one block scan need no clearing
+  int scan = 0;
+  std::vector<int> seen;
+  std::vector<BitVector> availOut;
+  std::vector<BitVector> antIn;
+  std::vector<BitVector> antOut;
+  std::vector<BitVector> laterIn;
+  std::vector<Operand> tmp;
+};
+
+}  // namespace
+
+bool lazyCodeMotion(CFG& cfg) { return LazyCodeMotion(cfg).run(); }
+
+}  // namespace cs160::midend
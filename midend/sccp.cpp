@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "midend/index_table.h"
+#include "midend/passes.h"
+
+// Sparse conditional constant propagation (Wegman and Zadeck) on SSA form.
+// Every SSA name holds a lattice value, Top (no value seen yet), a constant
+// or Bottom (varies), and only blocks reached through an edge found
+// executable are evaluated. A branch on a constant makes only one of its
+// edges executable, so constants are also found past branches whose other
+// side would have spoiled them. Names defined nowhere (the values on
+// entry) are Bottom.
+
+namespace cs160::midend {
+
+namespace {
+
+struct LatticeValue {
+  enum State { Top, Constant, Bottom };
+  State state = Top;
+  int constant = 0;
+
+  bool operator==(const LatticeValue& rhs) const {
+    return state == rhs.state &&
+           (state != Constant || constant == rhs.constant);
+  }
+};
+
+LatticeValue meet(const LatticeValue& a, const LatticeValue& b) {
+  if (a.state == LatticeValue::Top) {
+    return b;
+  }
+  if (b.state == LatticeValue::Top || a == b) {
+    return a;
+  }
+  return {LatticeValue::Bottom, 0};
+}
+
+class SparseConditionalConstants {
+ public:
+  explicit SparseConditionalConstants(CFG& cfg)
+      : cfg(cfg), visited(cfg.size(), false), executable(cfg.size()) {}
+
+  bool run() {
+    if (cfg.size() == 0) {
+      return false;
+    }
+    collectNames();
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      executable[b].assign(cfg.successors(b).size(), false);
+    }
+    visitBlock(0);
+    while (!blockWorklist.empty() || !nameWorklist.empty()) {
+      while (!blockWorklist.empty()) {
+        int b = blockWorklist.back();
+        blockWorklist.pop_back();
+        visitBlock(b);
+      }
+      while (!nameWorklist.empty()) {
+        int name = nameWorklist.back();
+        nameWorklist.pop_back();
+        for (auto [b, i] : uses[name]) {
+          if (!visited[b]) {
+            continue;
+          }
+          if (i < 0) {
+            evaluatePhi(b, -i - 1);
+          } else {
+            evaluate(b, i);
+          }
+        }
+      }
+    }
+    return rewrite();
+  }
+
+ private:
+  // (block, instruction index), or (block, -1 - phi index) for phis
+  using Use = std::pair<int, int>;
+
+  void collectNames() {
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      const auto& block = cfg.getBlocks()[b];
+      for (const auto& phi : block.phis()) {
+        names.insert(phi.lhs);
+      }
+      for (const auto& instr : block.instructions()) {
+        if (instr.isDefinition()) {
+          names.insert(instr.getOperand0());
+        }
+      }
+    }
+    values.resize(names.size());
+    uses.resize(names.size());
+    for (int b = 0; b < static_cast<int>(cfg.size()); ++b) {
+      const auto& block = cfg.getBlocks()[b];
+      for (int p = 0; p < static_cast<int>(block.phis().size()); ++p) {
+        for (const auto& arg : block.phis()[p].args) {
+          addUse(arg, {b, -1 - p});
+        }
+      }
+      const auto& instrs = block.instructions();
+      for (int i = 0; i < static_cast<int>(instrs.size()); ++i) {
+        instrs[i].forEachUse(
+            [&](const Operand& use) { addUse(use, {b, i}); });
+      }
+    }
+  }
+
+  void addUse(const Operand& operand, Use use) {
+    int name = names.find(operand);
+    if (name >= 0 && (uses[name].empty() || uses[name].back() != use)) {
+      uses[name].push_back(use);
+    }
+  }
+
+  LatticeValue valueOf(const Operand& operand) const {
+    if (operand.GetOperandType() == OperandType::Int) {
+      return {LatticeValue::Constant, operand.GetConstant()};
+    }
+    int name = names.find(operand);
+    return name >= 0 ? values[name] : LatticeValue{LatticeValue::Bottom, 0};
+  }
+
+  void lower(const Operand& var, const LatticeValue& value) {
+    int name = names.find(var);
+    if (!(values[name] == value)) {
+      values[name] = value;
+      nameWorklist.push_back(name);
+    }
+  }
+
+  void markEdge(int from, int to) {
+    auto succs = cfg.successors(from);
+    auto k = std::lower_bound(succs.begin(), succs.end(), to) - succs.begin();
+    if (executable[from][k]) {
+      return;
+    }
+    executable[from][k] = true;
+    blockWorklist.push_back(to);
+  }
+
+  bool isExecutable(int from, int to) const {
+    auto succs = cfg.successors(from);
+    auto k = std::lower_bound(succs.begin(), succs.end(), to) - succs.begin();
+    return executable[from][k];
+  }
+
+  // Evaluates the phis of b for a newly executable edge, and the whole block
+  // the first time it is reached
+  void visitBlock(int b) {
+    for (std::size_t p = 0; p < cfg.getBlocks()[b].phis().size(); ++p) {
+      evaluatePhi(b, p);
+    }
+    if (visited[b]) {
+      return;
+    }
+    visited[b] = true;
+    const auto& instrs = cfg.getBlocks()[b].instructions();
+    for (std::size_t i = 0; i < instrs.size(); ++i) {
+      evaluate(b, i);
+    }
+    if (instrs.empty() ||
+        instrs.back().getOpcode() != Opcode::jump_conditional) {
+      for (int succ : cfg.successors(b)) {
+        markEdge(b, succ);
+      }
+    }
+  }
+
+  void evaluatePhi(int b, int p) {
+    const auto& phi = cfg.getBlocks()[b].phis()[p];
+    auto preds = cfg.predecessors(b);
+    LatticeValue value;
+    for (std::size_t i = 0; i < preds.size(); ++i) {
+      if (isExecutable(preds[i], b)) {
+        value = meet(value, valueOf(phi.args[i]));
+      }
+    }
+    lower(phi.lhs, value);
+  }
+
+  void evaluate(int b, int i) {
+    const auto& instr = cfg.getBlocks()[b].instructions()[i];
+    auto op = instr.getOpcode();
+    if (op == Opcode::jump_conditional) {
+      auto cond = valueOf(instr.getOperand0());
+      if (cond.state == LatticeValue::Top) {
+        return;
+      }
+      for (int succ : cfg.successors(b)) {
+        if (cond.state == LatticeValue::Bottom || succ == taken(b, cond)) {
+          markEdge(b, succ);
+        }
+      }
+      return;
+    }
+    if (!instr.isDefinition()) {
+      return;
+    }
+    if (op == Opcode::CALL) {
+      lower(instr.getOperand0(), {LatticeValue::Bottom, 0});
+      return;
+    }
+    if (op == Opcode::NIL) {
+      lower(instr.getOperand0(), valueOf(instr.getOperand1()));
+      return;
+    }
+    auto a = valueOf(instr.getOperand1());
+    auto c = instr.isBinary() ? valueOf(instr.getOperand2())
+                              : LatticeValue{LatticeValue::Constant, 0};
+    if (a.state == LatticeValue::Bottom || c.state == LatticeValue::Bottom) {
+      lower(instr.getOperand0(), {LatticeValue::Bottom, 0});
+    } else if (a.state == LatticeValue::Constant &&
+               c.state == LatticeValue::Constant) {
+      lower(instr.getOperand0(), {LatticeValue::Constant,
+                                  EvaluateOpcode(op, a.constant, c.constant)});
+    }
+  }
+
+  // The successor a conditional jump ending b goes to when its condition
+  // is the constant cond: the jump target on 0, the next block otherwise
+  int taken(int b, const LatticeValue& cond) const {
+    if (cond.constant != 0) {
+      return b + 1;
+    }
+    for (int succ : cfg.successors(b)) {
+      if (succ != b + 1) {
+        return succ;
+      }
+    }
+    return b + 1;
+  }
+
+  std::optional<int> constantOf(const Operand& operand) const {
+    auto value = valueOf(operand);
+    if (operand.GetOperandType() == OperandType::Var &&
+        value.state == LatticeValue::Constant) {
+      return value.constant;
+    }
+    return std::nullopt;
+  }
+
+  bool rewrite() {
+    bool changed = false;
+    auto n = cfg.size();
+    std::vector<int> newIndex(n, -1);
+    std::vector<BasicBlock> blocks;
+    for (std::size_t b = 0; b < n; ++b) {
+      if (!visited[b]) {
+        changed = true;
+        continue;
+      }
+      newIndex[b] = blocks.size();
+      const auto& block = cfg.getBlocks()[b];
+
+      std::vector<Phi> phis;
+      for (const auto& phi : block.phis()) {
+        if (valueOf(phi.lhs).state == LatticeValue::Constant) {
+          changed = true;
+          continue;
+        }
+        phis.push_back(phi);
+        for (auto& arg : phis.back().args) {
+          if (auto c = constantOf(arg)) {
+            arg = Operand(*c);
+          }
+        }
+      }
+
+      std::vector<Instruction> instrs;
+      for (auto instr : block.instructions()) {
+        instr.forEachUse([&](Operand& use) {
+          if (auto c = constantOf(use)) {
+            use = Operand(*c);
+            changed = true;
+          }
+        });
+        if (instr.getOpcode() == Opcode::jump_conditional &&
+            instr.getOperand0().GetOperandType() == OperandType::Int) {
+          changed = true;
+          if (instr.getOperand0().GetConstant() == 0) {
+            instrs.push_back(Instruction(Opcode::jump_unconditional,
+                                         instr.getJumpTarget()));
+          }
+          continue;
+        }
+        if (instr.isDefinition() && instr.getOpcode() != Opcode::CALL &&
+            instr.getOpcode() != Opcode::NIL) {
+          if (auto c = constantOf(instr.getOperand0())) {
+            instr = Instruction(instr.getOperand0(), Operand(*c));
+            changed = true;
+          }
+        }
+        instrs.push_back(std::move(instr));
+      }
+      blocks.push_back(BasicBlock(std::move(instrs), block.getBlockID()));
+      blocks.back().setPhis(std::move(phis));
+    }
+    if (!changed) {
+      return false;
+    }
+
+    // the phi argument of each executable edge, by old predecessor
+    std::vector<std::vector<std::pair<int, std::vector<Operand>>>> incoming(
+        blocks.size());
+    for (std::size_t b = 0; b < n; ++b) {
+      if (newIndex[b] < 0 || blocks[newIndex[b]].phis().empty()) {
+        continue;
+      }
+      auto preds = cfg.predecessors(b);
+      for (std::size_t i = 0; i < preds.size(); ++i) {
+        if (!isExecutable(preds[i], b)) {
+          continue;
+        }
+        std::vector<Operand> args;
+        for (const auto& phi : blocks[newIndex[b]].phis()) {
+          args.push_back(phi.args[i]);
+        }
+        incoming[newIndex[b]].emplace_back(newIndex[preds[i]], std::move(args));
+      }
+    }
+    cfg.setBlocks(std::move(blocks));
+
+    // the kept edges are exactly the executable ones, in the same order
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      if (incoming[b].empty()) {
+        continue;
+      }
+      auto phis = cfg.getBlocks()[b].phis();
+      for (std::size_t p = 0; p < phis.size(); ++p) {
+        phis[p].args.clear();
+        for (const auto& [pred, args] : incoming[b]) {
+          phis[p].args.push_back(args[p]);
+        }
+      }
+      cfg.getBlock(b).setPhis(std::move(phis));
+    }
+    return true;
+  }
+
+  CFG& cfg;
+  IndexTable<Operand, OperandHash> names;
+  std::vector<LatticeValue> values;
+  std::vector<std::vector<Use>> uses;
+  std::vector<bool> visited;
+  // executable[b][k]: whether the edge to the k-th successor of b is
+  std::vector<std::vector<bool>> executable;
+  std::vector<int> blockWorklist;
+  std::vector<int> nameWorklist;
+};
+
+}  // namespace
+
+bool sparseConditionalConstantPropagation(CFG& cfg) {
+  bool changed = constructSSA(cfg);
+  changed |= SparseConditionalConstants(cfg).run();
+  changed |= destructSSA(cfg);
+  changed |= removeUnusedTemporaries(cfg);
+  return changed;
+}
+
+}  // namespace cs160::midend
@@ -0,0 +1,197 @@
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "midend/passes.h"
+
+// Control flow cleanup. The IR generator starts a block at every label, so
+// an IF_END_n followed by a WHILE_START_m, or the join of a conditional
+// with an empty else branch, leaves blocks holding nothing but a label,
+// and passes like LCM and LICM add more. Three rewrites run until none
+// applies:
+//
+//   - jump threading: a jump to a block that holds only a jump, or only a
+//     label and falls through to a labelled block, goes straight to where
+//     that block leads; a jump to the next block is deleted;
+//   - blocks no path from the entry reaches are deleted;
+//   - a block that falls through to a next block that it is the only
+//     predecessor of absorbs that block, label and all.
+//
+// Blocks are then renumbered in order.
+
+namespace cs160::midend {
+
+namespace {
+
+bool isJump(const Instruction& instr) {
+  return !instr.isLabel() && (instr.getOpcode() == Opcode::jump_conditional ||
+                              instr.getOpcode() == Opcode::jump_unconditional);
+}
+
+// The label starting block b, if any
+std::optional<Operand> labelOf(const CFG& cfg, int b) {
+  const auto& instrs = cfg.getBlocks()[b].instructions();
+  if (instrs.empty()) {
+    return std::nullopt;
+  }
+  return instrs.front().getLabel();
+}
+
+bool threadJumps(CFG& cfg) {
+  auto n = static_cast<int>(cfg.size());
+  std::unordered_map<Operand, int, OperandHash> blockOf;
+  for (int b = 0; b < n; ++b) {
+    if (auto label = labelOf(cfg, b)) {
+      blockOf.emplace(*label, b);
+    }
+  }
+
+  // Where control entering block b ends up without doing anything, as far
+  // as a labelled block
+  std::vector<int> visited(n, -1);
+  auto forward = [&](int b, int mark) {
+    while (true) {
+      visited[b] = mark;
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      std::size_t first = !instrs.empty() && instrs.front().isLabel() ? 1 : 0;
+      int next = -1;
+      if (instrs.size() == first && b + 1 < n) {
+        next = b + 1;
+      } else if (instrs.size() == first + 1 &&
+                 instrs.back().getOpcode() == Opcode::jump_unconditional) {
+        auto target = blockOf.find(instrs.back().getJumpTarget());
+        next = target == blockOf.end() ? -1 : target->second;
+      }
+      if (next < 0 || visited[next] == mark || !labelOf(cfg, next) ||
+          !cfg.getBlocks()[next].phis().empty()) {
+        return b;
+      }
+      b = next;
+    }
+  };
+
+  bool changed = false;
+  auto blocks = cfg.getBlocks();
+  for (int b = 0; b < n; ++b) {
+    auto instrs = blocks[b].instructions();
+    if (instrs.empty() || !isJump(instrs.back())) {
+      continue;
+    }
+    auto target = blockOf.find(instrs.back().getJumpTarget());
+    if (target == blockOf.end()) {
+      continue;
+    }
+    int to = forward(target->second, b);
+    if (to == b + 1) {
+      instrs.pop_back();
+    } else if (to != target->second) {
+      instrs.back().setJumpTarget(*labelOf(cfg, to));
+    } else {
+      continue;
+    }
+    blocks[b].setInstructions(std::move(instrs));
+    changed = true;
+  }
+  if (changed) {
+    cfg.setBlocks(std::move(blocks));
+  }
+  return changed;
+}
+
+bool removeUnreachableBlocks(CFG& cfg) {
+  std::vector<bool> reached(cfg.size(), false);
+  std::vector<int> stack{0};
+  reached[0] = true;
+  while (!stack.empty()) {
+    int b = stack.back();
+    stack.pop_back();
+    for (int succ : cfg.successors(b)) {
+      if (!reached[succ]) {
+        reached[succ] = true;
+        stack.push_back(succ);
+      }
+    }
+  }
+  std::vector<BasicBlock> blocks;
+  for (std::size_t b = 0; b < cfg.size(); ++b) {
+    if (reached[b]) {
+      blocks.push_back(cfg.getBlocks()[b]);
+    }
+  }
+  if (blocks.size() == cfg.size()) {
+    return false;
+  }
+  cfg.setBlocks(std::move(blocks));
+  return true;
+}
+
+bool mergeBlocks(CFG& cfg) {
+  auto n = cfg.size();
+  auto absorbs = [&](std::size_t b) {
+    if (b + 1 >= n || !cfg.getBlocks()[b + 1].phis().empty()) {
+      return false;
+    }
+    auto succs = cfg.successors(b);
+    auto preds = cfg.predecessors(b + 1);
+    const auto& instrs = cfg.getBlocks()[b].instructions();
+    return succs.size() == 1 && succs[0] == static_cast<int>(b + 1) &&
+           preds.size() == 1 && (instrs.empty() || !isJump(instrs.back()));
+  };
+
+  std::vector<BasicBlock> blocks;
+  bool changed = false;
+  for (std::size_t b = 0; b < n; ++b) {
+    const auto& block = cfg.getBlocks()[b];
+    if (b == 0 || !absorbs(b - 1)) {
+      blocks.push_back(block);
+      continue;
+    }
+    auto instrs = blocks.back().instructions();
+    for (const auto& instr : block.instructions()) {
+      if (!instr.isLabel()) {
+        instrs.push_back(instr);
+      }
+    }
+    blocks.back().setInstructions(std::move(instrs));
+    changed = true;
+  }
+  if (changed) {
+    cfg.setBlocks(std::move(blocks));
+  }
+  return changed;
+}
+
+}  // namespace
+
+bool simplifyControlFlow(CFG& cfg) {
+  if (cfg.size() == 0) {
+    return false;
+  }
+  bool changed = false;
+  bool progress = true;
+  while (progress) {
+    progress = threadJumps(cfg);
+    progress |= removeUnreachableBlocks(cfg);
+    progress |= mergeBlocks(cfg);
+    changed |= progress;
+  }
+
+  bool numbered = true;
+  for (std::size_t b = 0; b < cfg.size(); ++b) {
+    numbered &= cfg.getBlocks()[b].getBlockID() == static_cast<int>(b);
+  }
+  if (!numbered) {
+    std::vector<BasicBlock> blocks;
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      const auto& block = cfg.getBlocks()[b];
+      blocks.push_back(BasicBlock(block.instructions(), b));
+      blocks.back().setPhis(block.phis());
+    }
+    cfg.setBlocks(std::move(blocks));
+    changed = true;
+  }
+  return changed;
+}
+
+}  // namespace cs160::midend
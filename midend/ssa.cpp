@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "midend/liveness.h"
+#include "midend/passes.h"
+
+// Construction follows Cytron et al.: phis for a variable go on the iterated
+// dominance frontier of its definitions, pruned to the blocks where the
+// variable is live on entry, then a walk over the dominator tree renames
+// every definition to a fresh version. Uses that no definition reaches keep
+// the unversioned name, which stands for the value on entry (a parameter or
+// an uninitialized variable).
+//
+// Destruction splits critical edges and turns the phis of a block into one
+// parallel copy per incoming edge, sequentialized so that swaps and cycles
+// go through a fresh temporary. Versioned names are kept; coalescing them
+// back together is left to later passes.
+
+namespace cs160::midend {
+
+namespace {
+
+void placePhis(const CFG& cfg, const Liveness& live,
+               std::vector<std::vector<Phi>>& phis,
+               std::vector<std::vector<int>>& phiVars) {
+  const auto& vars = live.variables();
+  std::vector<std::vector<int>> defsites(vars.size());
+  for (int b : cfg.reversePostorder()) {
+    for (const auto& instr : cfg.getBlocks()[b].instructions()) {
+      if (instr.isDefinition()) {
+        auto& sites = defsites[vars.find(instr.getOperand0())];
+        if (sites.empty() || sites.back() != b) {
+          sites.push_back(b);
+        }
+      }
+    }
+  }
+
+  // hasPhi and queued hold the last variable that placed a phi in, or
+  // queued, each block, so they need no clearing between variables
+  std::vector<int> hasPhi(cfg.size(), -1);
+  std::vector<int> queued(cfg.size(), -1);
+  std::vector<int> worklist;
+  for (std::size_t v = 0; v < vars.size(); ++v) {
+    for (int b : defsites[v]) {
+      queued[b] = v;
+      worklist.push_back(b);
+    }
+    while (!worklist.empty()) {
+      int b = worklist.back();
+      worklist.pop_back();
+      for (int frontier : cfg.dominanceFrontier(b)) {
+        if (hasPhi[frontier] == static_cast<int>(v) ||
+            !live.liveIn(frontier).test(v)) {
+          continue;
+        }
+        hasPhi[frontier] = v;
+        auto var = vars.key(v);
+        phis[frontier].push_back(Phi{
+            var,
+            std::vector<Operand>(cfg.predecessors(frontier).size(), var)});
+        phiVars[frontier].push_back(v);
+        if (queued[frontier] != static_cast<int>(v)) {
+          queued[frontier] = v;
+          worklist.push_back(frontier);
+        }
+      }
+    }
+  }
+}
+
+// Position of pred in the predecessor list of block
+int predecessorIndex(const CFG& cfg, int block, int pred) {
+  auto preds = cfg.predecessors(block);
+  return std::lower_bound(preds.begin(), preds.end(), pred) - preds.begin();
+}
+
+void rename(CFG& cfg, const Liveness& live, std::vector<std::vector<Phi>>& phis,
+            const std::vector<std::vector<int>>& phiVars) {
+  const auto& vars = live.variables();
+  std::vector<std::vector<Operand>> current(vars.size());
+  auto currentOf = [&](const Operand& var) {
+    int v = vars.find(var);
+    return v < 0 || current[v].empty() ? var : current[v].back();
+  };
+
+  // (block, next dominator tree child, variables pushed by the block)
+  struct Frame {
+    int block;
+    const int* next;
+    std::vector<int> pushed;
+  };
+  std::vector<Frame> stack;
+  auto enter = [&](int b) {
+    Frame frame{b, cfg.domChildren(b).begin(), {}};
+    for (std::size_t i = 0; i < phis[b].size(); ++i) {
+      int v = phiVars[b][i];
+      current[v].push_back(vars.key(v).newVersion());
+      phis[b][i].lhs = current[v].back();
+      frame.pushed.push_back(v);
+    }
+
+    auto instrs = cfg.getBlocks()[b].instructions();
+    for (auto& instr : instrs) {
+      instr.forEachUse([&](Operand& use) {
+        if (use.GetOperandType() == OperandType::Var) {
+          use = currentOf(use);
+        }
+      });
+      if (instr.isDefinition()) {
+        auto def = instr.getOperand0();
+        int v = vars.find(def);
+        current[v].push_back(def.newVersion());
+        frame.pushed.push_back(v);
+        instr.setOperand0(current[v].back());
+      }
+    }
+    cfg.getBlock(b).setInstructions(std::move(instrs));
+
+    for (int succ : cfg.successors(b)) {
+      int i = predecessorIndex(cfg, succ, b);
+      for (auto& phi : phis[succ]) {
+        phi.args[i] = currentOf(phi.args[i]);
+      }
+    }
+    stack.push_back(std::move(frame));
+  };
+
+  if (cfg.size() == 0) {
+    return;
+  }
+  enter(0);
+  while (!stack.empty()) {
+    auto& frame = stack.back();
+    if (frame.next == cfg.domChildren(frame.block).end()) {
+      for (int v : frame.pushed) {
+        current[v].pop_back();
+      }
+      stack.pop_back();
+      continue;
+    }
+    enter(*frame.next++);
+  }
+}
+
+// Orders the copies dst <- src of a parallel copy so that no source is
+// overwritten before it is read, breaking cycles with a fresh version of
+// one of the destinations
+std::vector<Instruction> sequentialize(
+    std::vector<std::pair<Operand, Operand>> copies) {
+  std::vector<Instruction> out;
+  copies.erase(std::remove_if(copies.begin(), copies.end(),
+                              [](const auto& copy) {
+                                return copy.first == copy.second;
+                              }),
+               copies.end());
+  while (!copies.empty()) {
+    auto ready = std::find_if(copies.begin(), copies.end(), [&](auto& copy) {
+      return std::none_of(copies.begin(), copies.end(), [&](auto& other) {
+        return other.second == copy.first;
+      });
+    });
+    if (ready == copies.end()) {
+      // every destination is still read: save one and redirect its readers
+      auto dst = copies.front().first;
+      auto saved = dst.newVersion();
+      out.push_back(Instruction(saved, dst));
+      for (auto& copy : copies) {
+        if (copy.second == dst) {
+          copy.second = saved;
+        }
+      }
+      continue;
+    }
+    out.push_back(Instruction(ready->first, ready->second));
+    copies.erase(ready);
+  }
+  return out;
+}
+
+}  // namespace
+
+bool constructSSA(CFG& cfg) {
+  cfg.isolateEntry();
+  Liveness live(cfg);
+  if (live.variables().empty()) {
+    return false;
+  }
+  std::vector<std::vector<Phi>> phis(cfg.size());
+  std::vector<std::vector<int>> phiVars(cfg.size());
+  placePhis(cfg, live, phis, phiVars);
+  rename(cfg, live, phis, phiVars);
+  for (std::size_t b = 0; b < cfg.size(); ++b) {
+    cfg.getBlock(b).setPhis(std::move(phis[b]));
+  }
+  return true;
+}
+
+bool destructSSA(CFG& cfg) {
+  bool hasPhis = std::any_of(
+      cfg.getBlocks().begin(), cfg.getBlocks().end(),
+      [](const BasicBlock& block) { return !block.phis().empty(); });
+  if (!hasPhis) {
+    return false;
+  }
+  cfg.splitCriticalEdges();
+
+  // copies to append to the end of each block, and to put at the top of
+  // blocks whose only predecessor branches elsewhere too
+  std::vector<std::vector<std::pair<Operand, Operand>>> atEnd(cfg.size());
+  std::vector<std::vector<std::pair<Operand, Operand>>> atStart(cfg.size());
+  for (std::size_t b = 0; b < cfg.size(); ++b) {
+    auto preds = cfg.predecessors(b);
+    for (const auto& phi : cfg.getBlocks()[b].phis()) {
+      for (std::size_t i = 0; i < preds.size(); ++i) {
+        auto& copies =
+            cfg.successors(preds[i]).size() == 1 ? atEnd[preds[i]] : atStart[b];
+        copies.emplace_back(phi.lhs, phi.args[i]);
+      }
+    }
+  }
+
+  for (std::size_t b = 0; b < cfg.size(); ++b) {
+    auto& block = cfg.getBlock(b);
+    block.setPhis({});
+    if (atEnd[b].empty() && atStart[b].empty()) {
+      continue;
+    }
+    auto instrs = block.instructions();
+    auto first = instrs.begin();
+    if (first != instrs.end() && first->isLabel()) {
+      ++first;
+    }
+    auto start = sequentialize(std::move(atStart[b]));
+    instrs.insert(first, start.begin(), start.end());
+    auto last = instrs.end();
+    if (!instrs.empty() &&
+        (instrs.back().getOpcode() == Opcode::jump_conditional ||
+         instrs.back().endsFallthrough())) {
+      --last;
+    }
+    auto end = sequentialize(std::move(atEnd[b]));
+    instrs.insert(last, end.begin(), end.end());
+    block.setInstructions(std::move(instrs));
+  }
+  return true;
+}
+
+}  // namespace cs160::midend
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "midend/index_table.h"
+#include "midend/liveness.h"
+#include "midend/passes.h"
+
+// Strength reduction of induction variables over natural loops.
+//
+// A basic induction variable i of a loop is assigned exactly once in the
+// loop, by i <- i + c or i <- i - c for a constant c. A product j <- i * k
+// with k constant or assigned nowhere in the loop becomes a copy of a new
+// variable _ivN, which is set to i * k in the preheader and advanced by
+// c * k right after the update of i, so _ivN == i * k holds throughout the
+// loop.
+//
+// Linear-function test replacement then rewrites the exit test of the
+// header, i < n or i <= n for increasing i (n < i, n <= i for decreasing
+// i), to compare _ivN against n * k. TAC arithmetic wraps around, so this
+// is only done when k is a positive constant and i starts from and is
+// compared against constants such that no i * k the loop computes
+// overflows. If i is then only read by its own update and is dead after
+// the loop, the update goes too.
+//
+// The pass expects assignments like i := i + 1 in the single instruction
+// form copy propagation leaves them in.
+
+namespace cs160::midend {
+
+namespace {
+
+struct InductionVariable {
+  int block;
+  std::size_t index;  // of the update in the block
+  int step;
+};
+
+// _ivN == i * factor
+struct ReducedVariable {
+  Operand var;
+  Operand i;
+  Operand factor;
+};
+
+// (block, index) of an instruction
+using Position = std::pair<int, std::size_t>;
+
+class StrengthReduction {
+ public:
+  explicit StrengthReduction(CFG& cfg) : cfg(cfg) {}
+
+  bool run() {
+    bool changed = cfg.isolateEntry();
+    changed |= cfg.insertPreheaders();
+    for (const auto& block : cfg.getBlocks()) {
+      for (const auto& instr : block.instructions()) {
+        if (instr.isDefinition() &&
+            instr.getOperand0().GetNameKind() == NameKind::Induction) {
+          next = std::max(next, instr.getOperand0().GetId() + 1);
+        }
+      }
+    }
+    for (auto l = cfg.loops().size(); l-- > 0;) {
+      changed |= reduce(l);
+    }
+    return changed;
+  }
+
+ private:
+  bool contains(const NaturalLoop& loop, int block) const {
+    return std::binary_search(loop.blocks.begin(), loop.blocks.end(), block);
+  }
+
+  Operand fresh() {
+    return Operand(NameKind::Induction, next++, OperandType::Var);
+  }
+
+  void findInductionVariables(const NaturalLoop& loop) {
+    vars.clear();
+    defs.clear();
+    basic.clear();
+    for (int b : loop.blocks) {
+      for (const auto& instr : cfg.getBlocks()[b].instructions()) {
+        if (instr.isDefinition()) {
+          std::size_t v = vars.insert(instr.getOperand0());
+          defs.resize(vars.size(), 0);
+          ++defs[v];
+        }
+      }
+    }
+    for (int b : loop.blocks) {
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      for (std::size_t k = 0; k < instrs.size(); ++k) {
+        const auto& instr = instrs[k];
+        if (!instr.isBinary()) {
+          continue;
+        }
+        auto op = instr.getOpcode();
+        auto i = instr.getOperand0();
+        auto lhs = instr.getOperand1();
+        auto rhs = instr.getOperand2();
+        if (op == Opcode::ADD && rhs == i) {
+          std::swap(lhs, rhs);
+        }
+        if ((op != Opcode::ADD && op != Opcode::SUB) || lhs != i ||
+            rhs.GetOperandType() != OperandType::Int ||
+            defs[vars.find(i)] != 1) {
+          continue;
+        }
+        int c = rhs.GetConstant();
+        basic[vars.find(i)] = {b, k, op == Opcode::ADD ? c : -c};
+      }
+    }
+  }
+
+  bool isInvariant(const Operand& operand) const {
+    return operand.GetOperandType() == OperandType::Int ||
+           (operand.GetOperandType() == OperandType::Var &&
+            vars.find(operand) < 0);
+  }
+
+  // The induction variable operand is, if it is one
+  const InductionVariable* inductionVariable(const Operand& operand) const {
+    int v = vars.find(operand);
+    auto found = basic.find(v);
+    return v < 0 || found == basic.end() ? nullptr : &found->second;
+  }
+
+  void reduceProducts(const NaturalLoop& loop) {
+    reduced.clear();
+    replace.clear();
+    std::map<std::pair<int, uint64_t>, std::size_t> index;
+    for (int b : loop.blocks) {
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      for (std::size_t k = 0; k < instrs.size(); ++k) {
+        const auto& instr = instrs[k];
+        if (!instr.isBinary() || instr.getOpcode() != Opcode::MUL) {
+          continue;
+        }
+        auto i = instr.getOperand1();
+        auto factor = instr.getOperand2();
+        if (!inductionVariable(i)) {
+          std::swap(i, factor);
+        }
+        if (!inductionVariable(i) || !isInvariant(factor)) {
+          continue;
+        }
+        auto key = std::make_pair(vars.find(i), factor.bits());
+        auto found = index.find(key);
+        if (found == index.end()) {
+          found = index.emplace(key, reduced.size()).first;
+          reduced.push_back({fresh(), i, factor});
+        }
+        replace.emplace(Position(b, k),
+                        Instruction(instr.getOperand0(),
+                                    reduced[found->second].var));
+      }
+    }
+  }
+
+  // The constant i holds on entry to the loop, if the blocks leading
+  // straight up to the preheader assign it one
+  std::optional<int> initialValue(int preheader, const Operand& i) const {
+    for (int b = preheader;;) {
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+        if (it->isDefinition() && it->getOperand0() == i) {
+          if (it->getOpcode() == Opcode::NIL &&
+              it->getOperand1().GetOperandType() == OperandType::Int) {
+            return it->getOperand1().GetConstant();
+          }
+          return std::nullopt;
+        }
+      }
+      if (cfg.predecessors(b).size() != 1) {
+        return std::nullopt;
+      }
+      b = cfg.predecessors(b)[0];
+    }
+  }
+
+  // Rewrites the exit test of the header, t <- i op n; jump_if_0 t, into a
+  // test on a reduced variable of i where that is exact
+  void replaceTest(const NaturalLoop& loop, int preheader) {
+    const auto& instrs = cfg.getBlocks()[loop.header].instructions();
+    if (instrs.empty() ||
+        instrs.back().getOpcode() != Opcode::jump_conditional) {
+      return;
+    }
+    auto cond = instrs.back().getOperand0();
+    for (std::size_t k = instrs.size() - 1; k-- > 0;) {
+      const auto& test = instrs[k];
+      if (!test.isDefinition() || test.getOperand0() != cond) {
+        continue;
+      }
+      auto op = test.getOpcode();
+      if (op != Opcode::LT && op != Opcode::LE) {
+        return;
+      }
+      // i on the left has to grow towards n, on the right shrink towards it
+      bool left = inductionVariable(test.getOperand1()) != nullptr;
+      auto i = left ? test.getOperand1() : test.getOperand2();
+      auto bound = left ? test.getOperand2() : test.getOperand1();
+      const auto* iv = inductionVariable(i);
+      if (!iv || bound.GetOperandType() != OperandType::Int ||
+          (left ? iv->step <= 0 : iv->step >= 0)) {
+        return;
+      }
+      auto init = initialValue(preheader, i);
+      if (!init) {
+        return;
+      }
+      for (const auto& r : reduced) {
+        if (r.i != i || r.factor.GetOperandType() != OperandType::Int ||
+            r.factor.GetConstant() <= 0) {
+          continue;
+        }
+        // i stays between init and the bound, overshooting by one step
+        int64_t reach = std::max(std::llabs(*init),
+                                 std::llabs(bound.GetConstant())) +
+                        std::llabs(iv->step);
+        if (reach * r.factor.GetConstant() > INT32_MAX) {
+          continue;
+        }
+        auto scaled = Operand(bound.GetConstant() * r.factor.GetConstant());
+        replace.emplace(Position(loop.header, k),
+                        left ? Instruction(cond, op, r.var, scaled)
+                             : Instruction(cond, op, scaled, r.var));
+        return;
+      }
+      return;
+    }
+  }
+
+  // Whether the loop still reads i, other than in its own update, once the
+  // replacements are made, or the code after the loop does
+  bool isRead(const NaturalLoop& loop, const Liveness& live, const Operand& i,
+              const InductionVariable& iv) const {
+    for (int b : loop.blocks) {
+      for (int succ : cfg.successors(b)) {
+        if (!contains(loop, succ) && live.isLiveIn(i, succ)) {
+          return true;
+        }
+      }
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      for (std::size_t k = 0; k < instrs.size(); ++k) {
+        if (b == iv.block && k == iv.index) {
+          continue;
+        }
+        auto found = replace.find(Position(b, k));
+        const auto& instr = found == replace.end() ? instrs[k] : found->second;
+        bool read = false;
+        instr.forEachUse([&](const Operand& use) { read |= use == i; });
+        if (read) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  bool reduce(int l) {
+    const auto& loop = cfg.loops()[l];
+    int preheader = cfg.preheader(l);
+    if (preheader < 0) {
+      return false;
+    }
+    findInductionVariables(loop);
+    if (basic.empty()) {
+      return false;
+    }
+    reduceProducts(loop);
+    if (reduced.empty()) {
+      return false;
+    }
+
+    // preheader setup, and the step of each reduced variable after the
+    // update of its induction variable
+    std::vector<Instruction> setup;
+    std::map<Position, std::vector<Instruction>> after;
+    for (const auto& r : reduced) {
+      const auto& iv = *inductionVariable(r.i);
+      setup.push_back(Instruction(r.var, Opcode::MUL, r.i, r.factor));
+      Operand delta;
+      if (r.factor.GetOperandType() == OperandType::Int) {
+        delta = Operand(
+            EvaluateOpcode(Opcode::MUL, iv.step, r.factor.GetConstant()));
+      } else if (iv.step == 1) {
+        delta = r.factor;
+      } else {
+        delta = fresh();
+        setup.push_back(
+            Instruction(delta, Opcode::MUL, r.factor, Operand(iv.step)));
+      }
+      after[Position(iv.block, iv.index)].push_back(
+          Instruction(r.var, Opcode::ADD, r.var, delta));
+    }
+
+    replaceTest(loop, preheader);
+    Liveness live(cfg);
+    std::vector<Position> dropped;
+    for (const auto& [v, iv] : basic) {
+      if (!isRead(loop, live, vars.key(v), iv)) {
+        dropped.emplace_back(iv.block, iv.index);
+      }
+    }
+
+    for (int b : loop.blocks) {
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      std::vector<Instruction> out;
+      bool blockChanged = false;
+      for (std::size_t k = 0; k < instrs.size(); ++k) {
+        Position position(b, k);
+        auto found = replace.find(position);
+        if (std::find(dropped.begin(), dropped.end(), position) !=
+            dropped.end()) {
+          blockChanged = true;
+        } else if (found != replace.end()) {
+          out.push_back(found->second);
+          blockChanged = true;
+        } else {
+          out.push_back(instrs[k]);
+        }
+        auto steps = after.find(position);
+        if (steps != after.end()) {
+          out.insert(out.end(), steps->second.begin(), steps->second.end());
+          blockChanged = true;
+        }
+      }
+      if (blockChanged) {
+        cfg.getBlock(b).setInstructions(std::move(out));
+      }
+    }
+
+    auto instrs = cfg.getBlocks()[preheader].instructions();
+    auto last = instrs.end();
+    if (!instrs.empty() &&
+        (instrs.back().getOpcode() == Opcode::jump_conditional ||
+         instrs.back().endsFallthrough())) {
+      --last;
+    }
+    instrs.insert(last, setup.begin(), setup.end());
+    cfg.getBlock(preheader).setInstructions(std::move(instrs));
+    return true;
+  }
+
+  CFG& cfg;
+  uint32_t next = 0;
+  // per loop: its variables with their number of assignments in it, its
+  // basic induction variables by variable, the reduced variables, and the
+  // instructions to rewrite
+  IndexTable<Operand, OperandHash> vars;
+  std::vector<int> defs;
+  std::map<int, InductionVariable> basic;
+  std::vector<ReducedVariable> reduced;
+  std::map<Position, Instruction> replace;
+};
+
+}  // namespace
+
+bool reduceStrength(CFG& cfg) { return StrengthReduction(cfg).run(); }
+
+}  // namespace cs160::midend
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "midend/liveness.h"
+#include "midend/passes.h"
+
+// Tail-recursion elimination. A self-call r <- CALL f is a tail call when
+// the only path on from it (no conditional jumps, no other calls) returns
+// either r itself or r + e or r * e, with e a constant or a variable that
+// path does not assign, so e already has its final value at the call.
+//
+// A tail call becomes a jump back to the start of the function, after
+// assigning the arguments to the parameters and resetting the variables a
+// fresh call would read as 0. For r + e and r * e, an accumulator _accN
+// starts out at 0 or 1 in a new entry block and takes _accN op e at each
+// such call, and every return of v becomes a return of _accN op v. Since +
+// and * are associative and commutative (wrapping around as well), this
+// returns what the chain of calls did: _accN op f(args) stays the result
+// of the original call. All calls turned into jumps must agree on op.
+
+namespace cs160::midend {
+
+namespace {
+
+struct TailCall {
+  int block;
+  std::size_t index;
+  // NIL when the result is returned as it is, else ADD or MUL with factor
+  Opcode op;
+  Operand factor;
+};
+
+// Whether the call at (b, k) passes as many arguments as f has parameters
+bool matchesArity(const CFG& cfg, int b, std::size_t k, std::size_t arity) {
+  const auto& instrs = cfg.getBlocks()[b].instructions();
+  std::size_t args = 0;
+  while (k-- > 0 && !instrs[k].isLabel() &&
+         instrs[k].getOpcode() != Opcode::CALL) {
+    args += instrs[k].getOpcode() == Opcode::arg;
+  }
+  return args == arity;
+}
+
+class TailRecursion {
+ public:
+  TailRecursion(CFG& cfg, const std::string& name,
+                const std::vector<Operand>& params)
+      : cfg(cfg), name(name), params(params) {}
+
+  bool run() {
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      if (!instrs.empty() && instrs.front().getLabel()) {
+        labels.emplace(*instrs.front().getLabel(), b);
+      }
+    }
+    std::vector<TailCall> calls;
+    Opcode op = Opcode::NIL;
+    for (std::size_t b = 0; b < cfg.size(); ++b) {
+      const auto& instrs = cfg.getBlocks()[b].instructions();
+      for (std::size_t k = 0; k < instrs.size(); ++k) {
+        if (instrs[k].isLabel() || instrs[k].getOpcode() != Opcode::CALL ||
+            instrs[k].getOperand1().GetVariableName() != name) {
+          continue;
+        }
+        if (!matchesArity(cfg, b, k, params.size())) {
+          continue;
+        }
+        auto call = tailCall(b, k);
+        if (!call || (call->op != Opcode::NIL && op != Opcode::NIL &&
+                      call->op != op)) {
+          continue;
+        }
+        if (call->op != Opcode::NIL) {
+          op = call->op;
+        }
+        calls.push_back(*call);
+      }
+    }
+    if (calls.empty()) {
+      return false;
+    }
+    VersionScope scope(cfg.versionCounters());
+    rewrite(calls, op);
+    return true;
+  }
+
+ private:
+  // The tail call r <- CALL f at (site, k) is, if it is one
+  std::optional<TailCall> tailCall(int site, std::size_t k) const {
+    const auto& blocks = cfg.getBlocks();
+    // the variables holding r, or r op e, as (op, e)
+    std::unordered_map<Operand, std::pair<Opcode, Operand>, OperandHash>
+        derived;
+    std::unordered_set<Operand, OperandHash> assigned;
+    int b = site;
+    auto result = blocks[b].instructions()[k].getOperand0();
+    derived.emplace(result, std::make_pair(Opcode::NIL, Operand()));
+    assigned.insert(result);
+    std::vector<bool> visited(cfg.size(), false);
+    visited[b] = true;
+
+    for (std::size_t i = k + 1;; i = 0) {
+      const auto& instrs = blocks[b].instructions();
+      int next = b + 1;
+      for (; i < instrs.size(); ++i) {
+        const auto& instr = instrs[i];
+        if (instr.isLabel()) {
+          continue;
+        }
+        auto op = instr.getOpcode();
+        if (op == Opcode::ret) {
+          auto found = derived.find(instr.getOperand0());
+          if (found == derived.end()) {
+            return std::nullopt;
+          }
+          return TailCall{site, k, found->second.first, found->second.second};
+        }
+        if (op == Opcode::jump_unconditional) {
+          auto target = labels.find(instr.getJumpTarget());
+          if (target == labels.end()) {
+            return std::nullopt;
+          }
+          next = target->second;
+          break;
+        }
+        if (!instr.isDefinition() || op == Opcode::CALL) {
+          return std::nullopt;
+        }
+        auto dst = instr.getOperand0();
+        std::optional<std::pair<Opcode, Operand>> value;
+        bool reads = false;
+        instr.forEachUse(
+            [&](const Operand& use) { reads |= derived.count(use) > 0; });
+        if (reads && op == Opcode::NIL) {
+          value = derived.at(instr.getOperand1());
+        } else if (reads && (op == Opcode::ADD || op == Opcode::MUL)) {
+          auto r = instr.getOperand1();
+          auto e = instr.getOperand2();
+          if (!derived.count(r)) {
+            std::swap(r, e);
+          }
+          if (derived.at(r).first != Opcode::NIL || derived.count(e) ||
+              assigned.count(e)) {
+            return std::nullopt;
+          }
+          value = std::make_pair(op, e);
+        } else if (reads) {
+          return std::nullopt;
+        }
+        derived.erase(dst);
+        if (value) {
+          derived.emplace(dst, *value);
+        }
+        assigned.insert(dst);
+      }
+      if (next >= static_cast<int>(cfg.size()) || visited[next]) {
+        return std::nullopt;
+      }
+      visited[next] = true;
+      b = next;
+    }
+  }
+
+  void rewrite(const std::vector<TailCall>& calls, Opcode op) {
+    const auto& old = cfg.getBlocks();
+    uint32_t nextLabel = 0, nextAcc = 0;
+    int nextID = 0;
+    for (const auto& block : old) {
+      nextID = std::max(nextID, block.getBlockID() + 1);
+      for (const auto& instr : block.instructions()) {
+        auto kind = instr.getOperand0().GetNameKind();
+        if (instr.isLabel() && kind == NameKind::TailStart) {
+          nextLabel = std::max(nextLabel, instr.getOperand0().GetId() + 1);
+        } else if (instr.isDefinition() && kind == NameKind::Accumulator) {
+          nextAcc = std::max(nextAcc, instr.getOperand0().GetId() + 1);
+        }
+      }
+    }
+    auto acc = Operand(NameKind::Accumulator, nextAcc, OperandType::Var);
+
+    // what a fresh call reads as 0
+    std::vector<Operand> resets;
+    Liveness live(cfg);
+    live.liveIn(0).forEachSetBit([&](std::size_t v) {
+      const auto& var = live.variables().key(v);
+      if (std::find(params.begin(), params.end(), var) == params.end()) {
+        resets.push_back(var);
+      }
+    });
+
+    const auto& entry = old[0].instructions();
+    std::optional<Operand> start;
+    if (!entry.empty()) {
+      start = entry.front().getLabel();
+    }
+    bool labelEntry = !start;
+    if (!start) {
+      start = Operand(NameKind::TailStart, nextLabel, OperandType::Label);
+    }
+
+    std::vector<BasicBlock> blocks;
+    if (op != Opcode::NIL) {
+      int identity = op == Opcode::MUL ? 1 : 0;
+      blocks.push_back(BasicBlock({Instruction(acc, Operand(identity))},
+                                  nextID++));
+    }
+    auto call = calls.begin();
+    for (std::size_t b = 0; b < old.size(); ++b) {
+      const auto& instrs = old[b].instructions();
+      std::vector<Instruction> out;
+      if (b == 0 && labelEntry) {
+        out.push_back(Instruction(*start));
+      }
+      if (call == calls.end() || call->block != static_cast<int>(b)) {
+        for (const auto& instr : instrs) {
+          if (op != Opcode::NIL && instr.getOpcode() == Opcode::ret &&
+              !instr.isLabel()) {
+            out.push_back(Instruction(acc, op, acc, instr.getOperand0()));
+            out.push_back(Instruction(Opcode::ret, acc));
+          } else {
+            out.push_back(instr);
+          }
+        }
+      } else {
+        jumpBack(instrs, *call, acc, resets, *start, out);
+        ++call;
+      }
+      blocks.push_back(BasicBlock(std::move(out), old[b].getBlockID()));
+      blocks.back().setPhis(old[b].phis());
+    }
+    cfg.setBlocks(std::move(blocks));
+  }
+
+  // Replaces the tail call and everything after it in its block with the
+  // jump back to start
+  void jumpBack(const std::vector<Instruction>& instrs, const TailCall& call,
+                const Operand& acc, const std::vector<Operand>& resets,
+                const Operand& start, std::vector<Instruction>& out) const {
+    // the arg instructions of the call, back to the previous call
+    std::vector<std::size_t> args;
+    for (auto k = call.index; k-- > 0;) {
+      if (instrs[k].isLabel() || instrs[k].getOpcode() == Opcode::CALL) {
+        break;
+      }
+      if (instrs[k].getOpcode() == Opcode::arg) {
+        args.push_back(k);
+      }
+    }
+    std::reverse(args.begin(), args.end());
+
+    // arguments may read parameters, so they are all evaluated first
+    std::vector<Operand> values;
+    for (std::size_t k = 0, j = 0; k < call.index; ++k) {
+      if (j < args.size() && args[j] == k) {
+        values.push_back(params[j].newVersion());
+        out.push_back(Instruction(values.back(), instrs[k].getOperand0()));
+        ++j;
+      } else {
+        out.push_back(instrs[k]);
+      }
+    }
+    if (call.op != Opcode::NIL) {
+      out.push_back(Instruction(acc, call.op, acc, call.factor));
+    }
+    for (std::size_t j = 0; j < params.size(); ++j) {
+      out.push_back(Instruction(params[j], values[j]));
+    }
+    for (const auto& var : resets) {
+      out.push_back(Instruction(var, Operand(0)));
+    }
+    out.push_back(Instruction(Opcode::jump_unconditional, start));
+  }
+
+  CFG& cfg;
+  const std::string& name;
+  const std::vector<Operand>& params;
+  std::unordered_map<Operand, int, OperandHash> labels;
+};
+
+}  // namespace
+
+bool eliminateTailRecursion(Module& module) {
+  bool changed = false;
+  for (auto& [name, cfg] : module.functions) {
+    auto params = module.params.find(name);
+    if (params == module.params.end()) {
+      continue;
+    }
+    changed |= TailRecursion(*cfg, name, params->second).run();
+  }
+  return changed;
+}
+
+}  // namespace cs160::midend
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <utility>
+
+#include "midend/thread_pool.h"
+
+namespace cs160::midend {
+
+ThreadPool::ThreadPool(std::size_t threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (std::size_t i = 0; i < threads; ++i) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers.emplace_back([this, i] { work(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  std::size_t q;
+  {
+    std::lock_guard lock(mutex);
+    q = nextQueue++ % queues.size();
+  }
+  {
+    std::lock_guard lock(queues[q]->mutex);
+    queues[q]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard lock(mutex);
+    ++queued;
+    ++unfinished;
+  }
+  wake.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock lock(mutex);
+  idle.wait(lock, [this] { return unfinished == 0; });
+  if (failure) {
+    std::rethrow_exception(std::exchange(failure, nullptr));
+  }
+}
+
+// A task only counts as queued once it is in a queue, and a worker claims
+// one before looking for it, so take() always finds a task eventually.
+void ThreadPool::work(std::size_t self) {
+  while (true) {
+    {
+      std::unique_lock lock(mutex);
+      wake.wait(lock, [this] { return stopping || queued > 0; });
+      if (queued == 0) {
+        return;
+      }
+      --queued;
+    }
+    auto task = take(self);
+    std::exception_ptr thrown;
+    try {
+      task();
+    } catch (...) {
+      thrown = std::current_exception();
+    }
+    std::lock_guard lock(mutex);
+    if (thrown && !failure) {
+      failure = thrown;
+    }
+    if (--unfinished == 0) {
+      idle.notify_all();
+    }
+  }
+}
+
+std::function<void()> ThreadPool::take(std::size_t self) {
+  auto n = queues.size();
+  while (true) {
+    for (std::size_t k = 0; k < n; ++k) {
+      auto& queue = *queues[(self + k) % n];
+      std::lock_guard lock(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      auto task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return task;
+    }
+  }
+}
+
+}  // namespace cs160::midend
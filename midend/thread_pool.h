@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cs160::midend {
+
+// A fixed set of worker threads running submitted tasks. Every worker has
+// its own queue: tasks are dealt out to the queues in turn, a worker runs
+// the tasks of its own queue in the order they were submitted and, once
+// that is empty, steals the oldest task of another. Submitting the longest
+// tasks first has them start first, and workers left without long tasks
+// to run keep busy that way when task lengths are skewed.
+class ThreadPool {
+ public:
+  // 0 threads means one per hardware thread
+  explicit ThreadPool(std::size_t threads = 0);
+  // Finishes the tasks already submitted before joining the workers
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  std::size_t size() const { return workers.size(); }
+
+  void submit(std::function<void()> task);
+  // Blocks until every task submitted so far has finished, then rethrows
+  // the first exception one of them threw, if any
+  void wait();
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void work(std::size_t self);
+  // Removes a task from the queues, looking at the worker's own first
+  std::function<void()> take(std::size_t self);
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake, idle;
+  // tasks in the queues not yet claimed by a worker, and tasks not yet
+  // finished, both guarded by mutex
+  std::size_t queued = 0, unfinished = 0;
+  std::size_t nextQueue = 0;
+  bool stopping = false;
+  std::exception_ptr failure;
+};
+
+}  // namespace cs160::midend
@@ -1,7 +1,4 @@
-for file in ./tests/*.l1
-do
-    build/c1 "${file}" "${file}.trial"
-done
+build/c1 --batch --suffix=.trial ./tests/*.l1
 
 
 